@@ -3,13 +3,40 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+#include "devices/elevator.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If the controller is a PCI IDE controller capable of bus
+   mastering, such as the PIIX emulated by QEMU and Bochs, then
+   data moves by DMA: the driver describes the buffer to the
+   controller in a table of physical regions and sleeps until the
+   completion interrupt, instead of copying every word through
+   the data port itself.  Otherwise, data moves by programmed
+   I/O.
+
+   Each channel has a queue of requests and a dispatcher thread
+   that carries them out one after another, so that a thread can
+   submit a request with disk_submit() and go on with its work
+   while the disk is busy.  disk_read() and the other synchronous
+   functions submit a request and wait for it to complete.  The
+   queue is an elevator (see devices/elevator.h), which chooses
+   the order of requests and merges adjacent requests into a
+   single command.
+
+   disk_stripe() combines disks on different channels into a
+   single striped disk (RAID-0).  A transfer to or from a striped
+   disk is split into requests for its member disks, which the
+   channels' dispatchers then carry out at the same time. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -28,10 +55,24 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prd(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
+/* Bus master command register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master status register bits. */
+#define BM_STA_ERR 0x02         /* Error (write 1 to clear). */
+#define BM_STA_IRQ 0x04         /* Interrupt (write 1 to clear). */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,19 +88,85 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Maximum number of sectors in a single command. */
+#define MAX_SECTORS_PER_COMMAND 256
 
-/* An ATA device. */
+/* Number of consecutive sectors of a striped disk stored on one
+   member disk before moving on to the next. */
+#define STRIPE_SECTORS 8
+
+/* Maximum number of requests that a synchronous transfer has
+   outstanding at once. */
+#define SYNC_BATCH 8
+
+/* We support the two "legacy" ATA channels found in a standard PC. */
+#define CHANNEL_CNT 2
+
+/* An ATA device, or a striped disk made up of ATA devices. */
 struct disk 
   {
     char name[8];               /* Name, e.g. "hd0:1". */
     struct channel *channel;    /* Channel disk is on. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
+    struct disk *members[CHANNEL_CNT]; /* Disks striped to form this
+                                   one, if MEMBER_CNT > 0. */
+    size_t member_cnt;          /* Number of members, 0 if physical. */
 
     bool is_ata;                /* 1=This device is an ATA disk. */
     disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+    int block_size;             /* Sectors per interrupt for
+                                   READ/WRITE MULTIPLE, or 0 if those
+                                   commands are not enabled. */
+    bool dma;                   /* Transfer data by DMA? */
+
+    struct disk_stats stats;    /* Statistics. */
+    int queue_depth;            /* Requests submitted, not completed. */
+    int64_t queue_changed;      /* When QUEUE_DEPTH last changed, in
+                                   microseconds since boot. */
+    disk_sector_t next_sector;  /* Sector after last command's last. */
+  };
+
+/* A physical region descriptor, which tells the bus master where
+   in physical memory to transfer some of the data for a DMA
+   command.  A region may not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address of region. */
+    uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT if last region. */
+  };
 
-    long long read_cnt;         /* Number of sectors read. */
-    long long write_cnt;        /* Number of sectors written. */
+#define PRD_EOT 0x8000          /* End of table. */
+
+/* Maximum number of regions for one command.  A buffer of N
+   bytes crosses at most N / 64 kB + 1 boundaries, so a command's
+   ELEVATOR_MERGE_MAX buffers, which total at most 128 kB, need at
+   most 2 * ELEVATOR_MERGE_MAX + 2 regions.  The table is aligned
+   on its size, a power of 2, so that it does not cross a 64 kB
+   boundary itself. */
+#define PRD_CNT 64
+
+/* A single ATA command, which transfers up to 256 consecutive
+   sectors to or from a list of buffers. */
+struct command
+  {
+    struct disk *disk;          /* Disk. */
+    disk_sector_t sector;       /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    bool write;                 /* True to write, false to read. */
+    struct segment              /* Buffers, in order. */
+      {
+        uint8_t *buffer;        /* CNT * DISK_SECTOR_SIZE bytes. */
+        size_t cnt;             /* Number of sectors. */
+      }
+    segs[ELEVATOR_MERGE_MAX];
+    size_t seg_cnt;             /* Number of buffers. */
   };
 
 /* An ATA channel (aka controller).
@@ -70,32 +177,54 @@ struct channel
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
+    struct lock lock;           /* Protects elevator. */
+    struct elevator elevator;   /* Pending struct disk_requests. */
+    struct condition queue_nonempty;    /* Signaled when a request
+                                           is queued. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base I/O port, or 0. */
+    struct prd prds[PRD_CNT]    /* Regions for current DMA command. */
+      __attribute__ ((aligned (sizeof (struct prd) * PRD_CNT)));
+
     struct disk devices[2];     /* The devices on this channel. */
   };
 
-/* We support the two "legacy" ATA channels found in a standard PC. */
-#define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+/* The striped disk, if disk_stripe() has been called. */
+static struct disk striped_disk;
+
+/* If true, never use DMA.
+   Controlled by the kernel command-line option "-pio". */
+bool disk_pio_only;
+
+static void find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void enable_multiple_mode (struct disk *, int block_size);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static void transfer (struct list *batch);
+static void execute (struct command *);
+static void pio_read (struct command *);
+static void pio_write (struct command *);
+static bool dma_possible (const struct command *);
+static void dma_transfer (struct command *);
 
 static void wait_until_idle (const struct disk *);
 static bool wait_while_busy (const struct disk *);
 static void select_device (const struct disk *);
 static void select_device_wait (const struct disk *);
 
+static void dispatcher (void *channel);
+static void update_queue_depth (struct disk *, int delta);
 static void interrupt_handler (struct intr_frame *);
 
 /* Initialize the disk subsystem and detect disks. */
@@ -104,6 +233,7 @@ disk_init (void)
 {
   size_t chan_no;
 
+  find_bus_master ();
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -125,6 +255,8 @@ disk_init (void)
           NOT_REACHED ();
         }
       lock_init (&c->lock);
+      elevator_init (&c->elevator);
+      cond_init (&c->queue_nonempty);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
  
@@ -135,11 +267,17 @@ disk_init (void)
           snprintf (d->name, sizeof d->name, "%s:%d", c->name, dev_no);
           d->channel = c;
           d->dev_no = dev_no;
+          d->member_cnt = 0;
 
           d->is_ata = false;
           d->capacity = 0;
+          d->block_size = 0;
+          d->dma = false;
 
-          d->read_cnt = d->write_cnt = 0;
+          memset (&d->stats, 0, sizeof d->stats);
+          d->queue_depth = 0;
+          d->queue_changed = timer_usecs ();
+          d->next_sector = 0;
         }
 
       /* Register interrupt handler. */
@@ -156,9 +294,49 @@ disk_init (void)
       for (dev_no = 0; dev_no < 2; dev_no++)
         if (c->devices[dev_no].is_ata)
           identify_ata_device (&c->devices[dev_no]);
+
+      /* Start carrying out requests. */
+      if (c->devices[0].is_ata || c->devices[1].is_ata)
+        thread_create (c->name, PRI_MAX, dispatcher, c);
     }
 }
 
+/* Prints statistics for disk D. */
+static void
+print_disk_stats (struct disk *d) 
+{
+  struct disk_stats st;
+  long long depth_x100;
+  int i;
+
+  disk_get_stats (d, &st);
+  printf ("%s: %lld reads, %lld writes, %lld by DMA\n",
+          d->name, st.read_cnt, st.write_cnt, st.dma_cnt);
+  if (st.cmd_cnt == 0)
+    return;
+
+  depth_x100 = (st.elapsed_usecs > 0
+                ? st.queue_usecs * 100 / st.elapsed_usecs : 0);
+  printf ("%s: %lld bytes in %lld commands (%lld sequential, "
+          "%lld random), average queue depth %lld.%02lld\n",
+          d->name, (st.read_cnt + st.write_cnt) * DISK_SECTOR_SIZE,
+          st.cmd_cnt, st.seq_cnt, st.cmd_cnt - st.seq_cnt,
+          depth_x100 / 100, depth_x100 % 100);
+  for (i = 0; i < DISK_LATENCY_BUCKETS; i++)
+    if (st.latency[i] > 0) 
+      {
+        if (i == 0)
+          printf ("%s:   service time < 2 us: %lld\n",
+                  d->name, st.latency[i]);
+        else if (i == DISK_LATENCY_BUCKETS - 1)
+          printf ("%s:   service time >= %lu us: %lld\n",
+                  d->name, 1ul << i, st.latency[i]);
+        else
+          printf ("%s:   service time %lu-%lu us: %lld\n",
+                  d->name, 1ul << i, (1ul << (i + 1)) - 1, st.latency[i]);
+      }
+}
+
 /* Prints disk statistics. */
 void
 disk_print_stats (void) 
@@ -173,12 +351,27 @@ disk_print_stats (void)
         {
           struct disk *d = disk_get (chan_no, dev_no);
           if (d != NULL && d->is_ata) 
-            printf ("%s: %lld reads, %lld writes\n",
-                    d->name, d->read_cnt, d->write_cnt);
+            print_disk_stats (d);
         }
     }
 }
 
+/* Copies disk D's statistics, which must be a physical disk,
+   into *STATS. */
+void
+disk_get_stats (struct disk *d, struct disk_stats *stats) 
+{
+  struct channel *c;
+
+  ASSERT (d != NULL && d->member_cnt == 0);
+
+  c = d->channel;
+  lock_acquire (&c->lock);
+  update_queue_depth (d, 0);
+  *stats = d->stats;
+  lock_release (&c->lock);
+}
+
 /* Returns the disk numbered DEV_NO--either 0 or 1 for master or
    slave, respectively--within the channel numbered CHAN_NO.
 
@@ -202,6 +395,38 @@ disk_get (int chan_no, int dev_no)
   return NULL;
 }
 
+/* Returns a disk that stripes its sectors across disks A and B,
+   which must be on different channels, STRIPE_SECTORS sectors at
+   a time.  Its capacity is twice that of the smaller of A and B,
+   rounded down to a whole number of stripes.  Only one striped
+   disk may be created. */
+struct disk *
+disk_stripe (struct disk *a, struct disk *b) 
+{
+  struct disk *d = &striped_disk;
+  disk_sector_t member_size;
+
+  ASSERT (a != NULL && b != NULL);
+  ASSERT (a->channel != b->channel);
+  ASSERT (a->member_cnt == 0 && b->member_cnt == 0);
+  ASSERT (d->member_cnt == 0);
+
+  member_size = a->capacity < b->capacity ? a->capacity : b->capacity;
+  member_size -= member_size % STRIPE_SECTORS;
+
+  snprintf (d->name, sizeof d->name, "md0");
+  d->channel = NULL;
+  d->dev_no = -1;
+  d->members[0] = a;
+  d->members[1] = b;
+  d->member_cnt = 2;
+  d->is_ata = false;
+  d->capacity = member_size * d->member_cnt;
+  printf ("%s: striped across %s and %s, %'"PRDSNu" sectors\n",
+          d->name, a->name, b->name, d->capacity);
+  return d;
+}
+
 /* Returns the size of disk D, measured in DISK_SECTOR_SIZE-byte
    sectors. */
 disk_sector_t
@@ -219,21 +444,7 @@ disk_size (struct disk *d)
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) 
 {
-  struct channel *c;
-  
-  ASSERT (d != NULL);
-  ASSERT (buffer != NULL);
-
-  c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  d->read_cnt++;
-  lock_release (&c->lock);
+  disk_read_multiple (d, sec_no, 1, buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -244,27 +455,474 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer)
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
 {
-  struct channel *c;
-  
+  disk_write_multiple (d, sec_no, 1, buffer);
+}
+
+/* Completion function for synchronous requests. */
+static void
+wake_submitter (struct disk_request *r) 
+{
+  sema_up (r->aux);
+}
+
+/* Finds where sectors SEC_NO through SEC_NO + CNT - 1 of disk D
+   are stored.  Stores the physical disk and sector that hold
+   SEC_NO in *MEMBER and *MEMBER_SEC and returns the number of
+   sectors, at most CNT, that follow it there consecutively. */
+static size_t
+map_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt,
+             struct disk **member, disk_sector_t *member_sec) 
+{
+  disk_sector_t stripe, stripe_ofs;
+
+  if (d->member_cnt == 0) 
+    {
+      *member = d;
+      *member_sec = sec_no;
+      return cnt;
+    }
+
+  stripe = sec_no / STRIPE_SECTORS;
+  stripe_ofs = sec_no % STRIPE_SECTORS;
+  *member = d->members[stripe % d->member_cnt];
+  *member_sec = stripe / d->member_cnt * STRIPE_SECTORS + stripe_ofs;
+  return (cnt < STRIPE_SECTORS - stripe_ofs
+          ? cnt : STRIPE_SECTORS - stripe_ofs);
+}
+
+/* Carries out a request to read or write CNT sectors starting at
+   SEC_NO on disk D, to or from BUFFER, and waits for it to
+   finish.  If D is striped, requests for different members are
+   outstanding at the same time. */
+static void
+transfer_sync (struct disk *d, disk_sector_t sec_no, size_t cnt,
+               void *buffer_, bool write) 
+{
+  struct disk_request r[SYNC_BATCH];
+  struct semaphore done;
+  uint8_t *buffer = buffer_;
+
   ASSERT (d != NULL);
+  ASSERT (sec_no + cnt <= d->capacity);
+
+  sema_init (&done, 0);
+  while (cnt > 0) 
+    {
+      size_t req_cnt, i;
+
+      for (req_cnt = 0; req_cnt < SYNC_BATCH && cnt > 0; req_cnt++) 
+        {
+          struct disk *member;
+          disk_sector_t member_sec;
+          size_t n = map_sectors (d, sec_no, cnt, &member, &member_sec);
+
+          disk_request_init (&r[req_cnt], member, member_sec, n, buffer,
+                             write, wake_submitter, &done);
+          disk_submit (&r[req_cnt]);
+          buffer += n * DISK_SECTOR_SIZE;
+          sec_no += n;
+          cnt -= n;
+        }
+      for (i = 0; i < req_cnt; i++)
+        sema_down (&done);
+    }
+}
+
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, size_t cnt,
+                    void *buffer) 
+{
+  transfer_sync (d, sec_no, cnt, buffer, false);
+}
+
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write_multiple (struct disk *d, disk_sector_t sec_no, size_t cnt,
+                     const void *buffer)
+{
+  transfer_sync (d, sec_no, cnt, (void *) buffer, true);
+}
+
+/* Initializes R as a request to read CNT consecutive sectors
+   starting at SEC_NO from disk D into BUFFER, or to write them
+   from BUFFER if WRITE is true.  BUFFER must have room for CNT *
+   DISK_SECTOR_SIZE bytes.  Once the transfer is done, COMPLETE
+   will be called with R, whose AUX member is set to AUX. */
+void
+disk_request_init (struct disk_request *r, struct disk *d,
+                   disk_sector_t sec_no, size_t cnt, void *buffer,
+                   bool write, disk_complete_func *complete, void *aux) 
+{
+  ASSERT (d != NULL);
+  ASSERT (cnt > 0);
   ASSERT (buffer != NULL);
+  ASSERT (complete != NULL);
+
+  r->disk = d;
+  r->sector = sec_no;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->write = write;
+  r->complete = complete;
+  r->aux = aux;
+}
+
+/* Queues request R, which must have been initialized with
+   disk_request_init(), and returns without waiting for it.  R and
+   its buffer must stay valid until R's completion function is
+   called.  The completion function runs in the dispatcher thread
+   for R's disk, which cannot start another request until it
+   returns, so it should not block for long.  R's disk may not be
+   a striped disk. */
+void
+disk_submit (struct disk_request *r) 
+{
+  struct channel *c = r->disk->channel;
+
+  ASSERT (r->disk->member_cnt == 0);
+  ASSERT (r->sector + r->cnt <= r->disk->capacity);
 
-  c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  d->write_cnt++;
+  update_queue_depth (r->disk, 1);
+  elevator_add (&c->elevator, r);
+  cond_signal (&c->queue_nonempty, &c->lock);
   lock_release (&c->lock);
 }
-
+
+/* Data transfer. */
+
+/* Dispatcher thread for CHANNEL.  Carries out the requests in its
+   queue in the order chosen by the elevator, keeping the disk busy
+   as long as there are requests. */
+static void
+dispatcher (void *channel) 
+{
+  struct channel *c = channel;
+
+  for (;;) 
+    {
+      struct list batch;
+
+      lock_acquire (&c->lock);
+      while (elevator_empty (&c->elevator))
+        cond_wait (&c->queue_nonempty, &c->lock);
+      elevator_next (&c->elevator, &batch, MAX_SECTORS_PER_COMMAND);
+      lock_release (&c->lock);
+
+      transfer (&batch);
+
+      lock_acquire (&c->lock);
+      update_queue_depth (list_entry (list_front (&batch),
+                                      struct disk_request, elem)->disk,
+                          -(int) list_size (&batch));
+      lock_release (&c->lock);
+
+      while (!list_empty (&batch)) 
+        {
+          struct disk_request *r = list_entry (list_pop_front (&batch),
+                                               struct disk_request, elem);
+          r->complete (r);
+        }
+    }
+}
+
+/* Adds DELTA to the number of requests queued or in progress for
+   disk D, first adding the time-weighted old depth to D's
+   statistics.  The caller must hold D's channel lock. */
+static void
+update_queue_depth (struct disk *d, int delta) 
+{
+  int64_t now = timer_usecs ();
+
+  if (now > d->queue_changed) 
+    {
+      d->stats.queue_usecs += d->queue_depth * (now - d->queue_changed);
+      d->stats.elapsed_usecs += now - d->queue_changed;
+      d->queue_changed = now;
+    }
+  d->queue_depth += delta;
+  ASSERT (d->queue_depth >= 0);
+}
+
+/* Carries out the requests in BATCH, which must read or write
+   consecutive sectors in ascending order on one disk, with as
+   few commands as possible.  Only the disk's channel's
+   dispatcher thread may call this function. */
+static void
+transfer (struct list *batch) 
+{
+  struct command cmd;
+  struct list_elem *e;
+
+  cmd.cnt = cmd.seg_cnt = 0;
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e)) 
+    {
+      struct disk_request *r = list_entry (e, struct disk_request, elem);
+      disk_sector_t sec_no = r->sector;
+      uint8_t *buffer = r->buffer;
+      size_t left = r->cnt;
+
+      ASSERT (cmd.cnt == 0 || (cmd.disk == r->disk && cmd.write == r->write
+                               && cmd.sector + cmd.cnt == sec_no));
+      while (left > 0) 
+        {
+          size_t n = MAX_SECTORS_PER_COMMAND - cmd.cnt;
+          if (n > left)
+            n = left;
+
+          if (cmd.cnt == 0) 
+            {
+              cmd.disk = r->disk;
+              cmd.sector = sec_no;
+              cmd.write = r->write;
+            }
+          cmd.segs[cmd.seg_cnt].buffer = buffer;
+          cmd.segs[cmd.seg_cnt].cnt = n;
+          cmd.seg_cnt++;
+          cmd.cnt += n;
+          buffer += n * DISK_SECTOR_SIZE;
+          sec_no += n;
+          left -= n;
+
+          if (cmd.cnt == MAX_SECTORS_PER_COMMAND
+              || cmd.seg_cnt == ELEVATOR_MERGE_MAX) 
+            {
+              execute (&cmd);
+              cmd.cnt = cmd.seg_cnt = 0;
+            }
+        }
+    }
+  if (cmd.cnt > 0)
+    execute (&cmd);
+}
+
+/* Carries out command CMD, by DMA if possible, and records its
+   service time, from issuing the command until the disk's last
+   interrupt. */
+static void
+execute (struct command *cmd) 
+{
+  struct disk *d = cmd->disk;
+  int64_t start, usecs;
+  int bucket;
+
+  if (cmd->sector == d->next_sector)
+    d->stats.seq_cnt++;
+  d->stats.cmd_cnt++;
+  d->next_sector = cmd->sector + cmd->cnt;
+
+  start = timer_usecs ();
+  if (dma_possible (cmd))
+    dma_transfer (cmd);
+  else if (cmd->write)
+    pio_write (cmd);
+  else
+    pio_read (cmd);
+  usecs = timer_usecs () - start;
+
+  for (bucket = 0; bucket < DISK_LATENCY_BUCKETS - 1; bucket++)
+    if (usecs < 2ll << bucket)
+      break;
+  d->stats.latency[bucket]++;
+
+  if (cmd->write)
+    d->stats.write_cnt += cmd->cnt;
+  else
+    d->stats.read_cnt += cmd->cnt;
+}
+
+/* Returns the address in CMD's buffers of the sector after the
+   one at *SEG, *OFS, and advances *SEG and *OFS past it. */
+static uint8_t *
+next_sector (const struct command *cmd, size_t *seg, size_t *ofs) 
+{
+  uint8_t *sector = cmd->segs[*seg].buffer + *ofs * DISK_SECTOR_SIZE;
+
+  if (++*ofs >= cmd->segs[*seg].cnt) 
+    {
+      ++*seg;
+      *ofs = 0;
+    }
+  return sector;
+}
+
+/* Carries out read command CMD by programmed I/O.  If the disk
+   supports READ MULTIPLE, the disk interrupts once per block of
+   several sectors, otherwise once per sector. */
+static void
+pio_read (struct command *cmd) 
+{
+  struct disk *d = cmd->disk;
+  struct channel *c = d->channel;
+  size_t block_size = d->block_size > 0 ? d->block_size : 1;
+  size_t seg = 0, ofs = 0;
+  size_t left;
+
+  select_sector (d, cmd->sector, cmd->cnt);
+  issue_pio_command (c, (d->block_size > 0
+                         ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY));
+  for (left = cmd->cnt; left > 0; ) 
+    {
+      size_t n = left < block_size ? left : block_size;
+
+      sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu,
+               d->name, cmd->sector + (cmd->cnt - left));
+      if (left > n)
+        c->expecting_interrupt = true;
+      for (; n > 0; n--, left--)
+        input_sector (c, next_sector (cmd, &seg, &ofs));
+    }
+}
+
+/* Carries out write command CMD by programmed I/O.  If the disk
+   supports WRITE MULTIPLE, the disk interrupts once per block of
+   several sectors, otherwise once per sector. */
+static void
+pio_write (struct command *cmd) 
+{
+  struct disk *d = cmd->disk;
+  struct channel *c = d->channel;
+  size_t block_size = d->block_size > 0 ? d->block_size : 1;
+  size_t seg = 0, ofs = 0;
+  size_t left;
+
+  select_sector (d, cmd->sector, cmd->cnt);
+  issue_pio_command (c, (d->block_size > 0
+                         ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY));
+  for (left = cmd->cnt; left > 0; ) 
+    {
+      size_t n = left < block_size ? left : block_size;
+
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu,
+               d->name, cmd->sector + (cmd->cnt - left));
+      for (; n > 0; n--, left--)
+        output_sector (c, next_sector (cmd, &seg, &ofs));
+      sema_down (&c->completion_wait);
+      if (left > 0)
+        c->expecting_interrupt = true;
+    }
+}
+
+/* Returns true if command CMD can move its data by DMA.  The bus
+   master needs the physical address of each buffer, so each must
+   be a kernel virtual address, and each must be word-aligned. */
+static bool
+dma_possible (const struct command *cmd) 
+{
+  size_t i;
+
+  if (!cmd->disk->dma)
+    return false;
+  for (i = 0; i < cmd->seg_cnt; i++)
+    if (!is_kernel_vaddr (cmd->segs[i].buffer)
+        || (uintptr_t) cmd->segs[i].buffer % 2 != 0)
+      return false;
+  return true;
+}
+
+/* Carries out command CMD by DMA. */
+static void
+dma_transfer (struct command *cmd) 
+{
+  struct disk *d = cmd->disk;
+  struct channel *c = d->channel;
+  uint8_t direction = cmd->write ? 0 : BM_CMD_READ;
+  struct prd *prd = c->prds;
+  uint8_t bm_status;
+  size_t i;
+
+  /* Describe each buffer's physical memory, which is contiguous
+     because the kernel maps physical memory linearly, in regions
+     that do not cross 64 kB boundaries. */
+  for (i = 0; i < cmd->seg_cnt; i++) 
+    {
+      uintptr_t addr = vtop (cmd->segs[i].buffer);
+      size_t size = cmd->segs[i].cnt * DISK_SECTOR_SIZE;
+
+      while (size > 0) 
+        {
+          size_t region = 0x10000 - (addr & 0xffff);
+          if (region > size)
+            region = size;
+
+          ASSERT (prd < c->prds + PRD_CNT);
+          prd->addr = addr;
+          prd->size = region;
+          prd->flags = 0;
+          prd++;
+          addr += region;
+          size -= region;
+        }
+    }
+  prd[-1].flags = PRD_EOT;
+
+  /* Program the bus master, issue the command, and start the
+     bus master.  The disk interrupts once the whole transfer is
+     done. */
+  outb (reg_bm_command (c), direction);
+  outl (reg_bm_prd (c), vtop (c->prds));
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_IRQ);
+  select_sector (d, cmd->sector, cmd->cnt);
+  issue_pio_command (c, cmd->write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+  sema_down (&c->completion_wait);
+
+  /* Stop the bus master and check for errors. */
+  outb (reg_bm_command (c), direction);
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_IRQ);
+  if ((bm_status & BM_STA_ERR) || (inb (reg_status (c)) & STA_ERR))
+    PANIC ("%s: disk DMA %s failed, sector=%"PRDSNu,
+           d->name, cmd->write ? "write" : "read", cmd->sector);
+  d->stats.dma_cnt += cmd->cnt;
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
 
+/* Looks for a PCI IDE controller that can act as a bus master
+   and, if there is one, records the bus master I/O ports for each
+   channel and allows the controller to master the bus.  Does
+   nothing if "-pio" was given on the kernel command line. */
+static void
+find_bus_master (void) 
+{
+  struct pci_dev pci;
+  uint32_t bar4;
+  size_t chan_no;
+
+  if (disk_pio_only || !pci_find_class (0x01, 0x01, &pci))
+    return;
+
+  /* Bit 7 of the programming interface says whether the
+     controller supports bus mastering.  Base address register 4
+     holds the bus master I/O ports, 8 for each channel. */
+  if (!(pci_read_config (&pci, PCI_REG_CLASS) & 0x8000))
+    return;
+  bar4 = pci_read_config (&pci, PCI_REG_BAR0 + 4 * 4);
+  if (!(bar4 & 1) || (bar4 & ~3u) == 0)
+    return;
+  pci_write_config (&pci, PCI_REG_COMMAND,
+                    (pci_read_config (&pci, PCI_REG_COMMAND)
+                     | PCI_CMD_IO | PCI_CMD_MASTER));
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    channels[chan_no].bm_base = (bar4 & ~3u) + 8 * chan_no;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -386,6 +1044,13 @@ identify_ata_device (struct disk *d)
   /* Calculate capacity. */
   d->capacity = id[60] | ((uint32_t) id[61] << 16);
 
+  /* Transfer as many sectors per interrupt as the disk allows. */
+  if ((id[47] & 0xff) > 1)
+    enable_multiple_mode (d, id[47] & 0xff);
+
+  /* Use DMA if both the controller and the disk support it. */
+  d->dma = c->bm_base != 0 && (id[49] & 0x100) != 0;
+
   /* Print identification message. */
   printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
   if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -404,6 +1069,24 @@ identify_ata_device (struct disk *d)
   printf ("\"\n");
 }
 
+/* Sends a SET MULTIPLE MODE command to disk D to make READ
+   MULTIPLE and WRITE MULTIPLE transfer BLOCK_SIZE sectors per
+   interrupt, and records the block size in D if the disk accepts
+   it. */
+static void
+enable_multiple_mode (struct disk *d, int block_size) 
+{
+  struct channel *c = d->channel;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), block_size);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->block_size = block_size;
+}
+
 /* Prints STRING, which consists of SIZE bytes in a funky format:
    each pair of bytes is in reverse order.  Does not print
    trailing whitespace and/or nulls. */
@@ -426,18 +1109,19 @@ print_ata_string (char *string, size_t size)
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, which must be between 1 and 256, to the
+   disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) 
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) 
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < d->capacity);
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_COMMAND);
+  ASSERT (sec_no + cnt <= d->capacity);
+  ASSERT (sec_no + cnt <= (1UL << 28));
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % MAX_SECTORS_PER_COMMAND);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -2,7 +2,11 @@
 #define DEVICES_DISK_H
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <disk-stats.h>
+#include <list.h>
 
 /* Size of a disk sector in bytes. */
 #define DISK_SECTOR_SIZE 512
@@ -15,12 +19,43 @@ typedef uint32_t disk_sector_t;
    printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* An asynchronous request to read or write consecutive sectors.
+   Initialize with disk_request_init(), then pass to
+   disk_submit(). */
+struct disk_request;
+typedef void disk_complete_func (struct disk_request *);
+struct disk_request
+  {
+    struct list_elem elem;      /* Element in channel's queue. */
+    struct list_elem fifo_elem; /* Element in queue's arrival order. */
+    int64_t deadline;           /* Timer tick to carry out by. */
+    struct disk *disk;          /* Disk to access. */
+    disk_sector_t sector;       /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    void *buffer;               /* CNT * DISK_SECTOR_SIZE bytes. */
+    bool write;                 /* True to write, false to read. */
+    disk_complete_func *complete; /* Called when transfer is done. */
+    void *aux;                  /* For use by COMPLETE. */
+  };
+
+extern bool disk_pio_only;
+
 void disk_init (void);
 void disk_print_stats (void);
 
 struct disk *disk_get (int chan_no, int dev_no);
+struct disk *disk_stripe (struct disk *, struct disk *);
+void disk_get_stats (struct disk *, struct disk_stats *);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_multiple (struct disk *, disk_sector_t, size_t cnt, void *);
+void disk_write_multiple (struct disk *, disk_sector_t, size_t cnt,
+                          const void *);
+
+void disk_request_init (struct disk_request *, struct disk *,
+                        disk_sector_t, size_t cnt, void *, bool write,
+                        disk_complete_func *, void *aux);
+void disk_submit (struct disk_request *);
 
 #endif /* devices/disk.h */
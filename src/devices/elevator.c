@@ -0,0 +1,136 @@
+#include "devices/elevator.h"
+#include <debug.h>
+#include "devices/timer.h"
+
+/* Number of timer ticks that a read or a write may wait before it
+   is carried out ahead of its turn.  Reads get a shorter deadline
+   because a thread is usually waiting for them. */
+#define READ_DEADLINE (TIMER_FREQ / 2)
+#define WRITE_DEADLINE (TIMER_FREQ * 5)
+
+bool elevator_fifo;
+
+/* Returns true if position (DA, SA) precedes position (DB, SB).
+   Disks are ordered by address, which within a channel is the
+   order of their device numbers. */
+static bool
+position_less (const struct disk *da, disk_sector_t sa,
+               const struct disk *db, disk_sector_t sb) 
+{
+  return da != db ? da < db : sa < sb;
+}
+
+/* Returns true if request A's position precedes request B's. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED) 
+{
+  const struct disk_request *a = list_entry (a_, struct disk_request, elem);
+  const struct disk_request *b = list_entry (b_, struct disk_request, elem);
+
+  return position_less (a->disk, a->sector, b->disk, b->sector);
+}
+
+/* Initializes elevator E with no pending requests. */
+void
+elevator_init (struct elevator *e) 
+{
+  list_init (&e->sorted);
+  list_init (&e->fifo);
+  e->head_disk = NULL;
+  e->head_sector = 0;
+}
+
+/* Returns true if elevator E has no pending requests. */
+bool
+elevator_empty (struct elevator *e) 
+{
+  return list_empty (&e->sorted);
+}
+
+/* Adds request R to elevator E. */
+void
+elevator_add (struct elevator *e, struct disk_request *r) 
+{
+  r->deadline = timer_ticks () + (r->write ? WRITE_DEADLINE : READ_DEADLINE);
+  list_insert_ordered (&e->sorted, &r->elem, request_less, NULL);
+  list_push_back (&e->fifo, &r->fifo_elem);
+}
+
+/* Removes request R from elevator E and appends it to BATCH. */
+static void
+take (struct elevator *e, struct disk_request *r, struct list *batch) 
+{
+  list_remove (&r->elem);
+  list_remove (&r->fifo_elem);
+  list_push_back (batch, &r->elem);
+  e->head_disk = r->disk;
+  e->head_sector = r->sector + r->cnt;
+}
+
+/* Removes the next requests to carry out from elevator E, which
+   must not be empty, and puts them into BATCH, which is
+   initialized by this function.  The requests in BATCH all read
+   or all write, on the same disk, consecutive sectors in
+   ascending order.  Requests are merged only as long as they
+   total no more than MAX_CNT sectors. */
+void
+elevator_next (struct elevator *e, struct list *batch, size_t max_cnt) 
+{
+  struct disk_request *r, *next;
+  struct list_elem *elem;
+  size_t cnt, req_cnt;
+
+  ASSERT (!elevator_empty (e));
+
+  list_init (batch);
+  r = list_entry (list_front (&e->fifo), struct disk_request, fifo_elem);
+  if (elevator_fifo) 
+    {
+      take (e, r, batch);
+      return;
+    }
+
+  /* Choose the first request at or past the head, wrapping
+     around if there is none, unless the oldest request is
+     overdue. */
+  if (timer_ticks () < r->deadline) 
+    {
+      for (elem = list_begin (&e->sorted); elem != list_end (&e->sorted);
+           elem = list_next (elem)) 
+        {
+          r = list_entry (elem, struct disk_request, elem);
+          if (!position_less (r->disk, r->sector,
+                              e->head_disk, e->head_sector))
+            break;
+        }
+      if (elem == list_end (&e->sorted))
+        r = list_entry (list_front (&e->sorted), struct disk_request, elem);
+    }
+
+  /* Merge the requests that follow it. */
+  cnt = r->cnt;
+  req_cnt = 1;
+  for (elem = list_next (&r->elem); elem != list_end (&e->sorted);
+       elem = list_next (elem)) 
+    {
+      next = list_entry (elem, struct disk_request, elem);
+      if (req_cnt >= ELEVATOR_MERGE_MAX
+          || next->disk != r->disk || next->write != r->write
+          || next->sector != r->sector + cnt
+          || cnt + next->cnt > max_cnt)
+        break;
+      cnt += next->cnt;
+      req_cnt++;
+    }
+
+  /* Move the chosen requests into BATCH. */
+  while (req_cnt-- > 0) 
+    {
+      next = (req_cnt > 0
+              ? list_entry (list_next (&r->elem), struct disk_request, elem)
+              : NULL);
+      take (e, r, batch);
+      r = next;
+    }
+}
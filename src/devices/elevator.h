@@ -0,0 +1,43 @@
+#ifndef DEVICES_ELEVATOR_H
+#define DEVICES_ELEVATOR_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+
+/* An I/O scheduler for the requests queued on one ATA channel.
+
+   Pending requests are carried out in C-LOOK order: in ascending
+   order of position, starting from the position just past the
+   last request carried out, then wrapping around to the lowest
+   position.  Requests that read or write sectors adjacent to the
+   chosen request are merged with it into a single transfer.  To
+   keep a request from waiting forever behind a stream of requests
+   ahead of it, a request whose deadline has passed is carried
+   out next regardless of its position.
+
+   Elevator functions do no locking of their own. */
+
+/* Maximum number of requests merged into one batch. */
+#define ELEVATOR_MERGE_MAX 16
+
+/* A channel's pending requests. */
+struct elevator
+  {
+    struct list sorted;         /* Requests in order of position. */
+    struct list fifo;           /* Requests in order of arrival. */
+    struct disk *head_disk;     /* Position just past the last */
+    disk_sector_t head_sector;  /* request carried out. */
+  };
+
+/* If true, carry out requests in order of arrival, unmerged.
+   Controlled by the kernel command-line option "-fifo". */
+extern bool elevator_fifo;
+
+void elevator_init (struct elevator *);
+bool elevator_empty (struct elevator *);
+void elevator_add (struct elevator *, struct disk_request *);
+void elevator_next (struct elevator *, struct list *batch, size_t max_cnt);
+
+#endif /* devices/elevator.h */
@@ -0,0 +1,71 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/* The code in this file reads and writes PCI configuration space
+   through configuration mechanism #1, which every PC chipset
+   since the PCI bus was introduced supports.  That is all we need
+   to find and program the few devices that Pintos drives. */
+
+/* Configuration mechanism #1 ports. */
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Returns the value to write to PCI_CONFIG_ADDRESS to access
+   register REG of PCI function D. */
+static uint32_t
+config_address (const struct pci_dev *d, int reg) 
+{
+  ASSERT (reg >= 0 && reg < 256 && reg % 4 == 0);
+
+  return (0x80000000u | ((uint32_t) d->bus << 16) | (d->dev << 11)
+          | (d->func << 8) | reg);
+}
+
+/* Returns the 32-bit register at offset REG in the configuration
+   space of PCI function D. */
+uint32_t
+pci_read_config (const struct pci_dev *d, int reg) 
+{
+  outl (PCI_CONFIG_ADDRESS, config_address (d, reg));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register at offset REG in the
+   configuration space of PCI function D. */
+void
+pci_write_config (const struct pci_dev *d, int reg, uint32_t value) 
+{
+  outl (PCI_CONFIG_ADDRESS, config_address (d, reg));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Searches the PCI buses for a function whose class code is CLASS
+   and whose subclass is SUBCLASS.  If one is found, stores its
+   position in *D and returns true.  Otherwise, returns false. */
+bool
+pci_find_class (int class, int subclass, struct pci_dev *d) 
+{
+  for (d->bus = 0; d->bus < 256; d->bus++)
+    for (d->dev = 0; d->dev < 32; d->dev++) 
+      {
+        int func_cnt;
+
+        d->func = 0;
+        if ((pci_read_config (d, PCI_REG_ID) & 0xffff) == 0xffff)
+          continue;
+        func_cnt = pci_read_config (d, PCI_REG_HEADER) & 0x800000 ? 8 : 1;
+        for (d->func = 0; d->func < func_cnt; d->func++) 
+          {
+            uint32_t class_reg;
+
+            if ((pci_read_config (d, PCI_REG_ID) & 0xffff) == 0xffff)
+              continue;
+            class_reg = pci_read_config (d, PCI_REG_CLASS);
+            if ((int) (class_reg >> 24) == class
+                && (int) ((class_reg >> 16) & 0xff) == subclass)
+              return true;
+          }
+      }
+  return false;
+}
@@ -0,0 +1,30 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A PCI function, identified by its position on the bus. */
+struct pci_dev
+  {
+    int bus;                    /* Bus number, 0...255. */
+    int dev;                    /* Device number, 0...31. */
+    int func;                   /* Function number, 0...7. */
+  };
+
+/* Offsets of some registers in PCI configuration space. */
+#define PCI_REG_ID 0x00         /* Device ID (31:16), vendor ID (15:0). */
+#define PCI_REG_COMMAND 0x04    /* Status (31:16), command (15:0). */
+#define PCI_REG_CLASS 0x08      /* Class, subclass, prog IF, revision. */
+#define PCI_REG_HEADER 0x0c     /* Header type in bits 23:16. */
+#define PCI_REG_BAR0 0x10       /* First of 6 base address registers. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_MASTER 0x0004   /* May act as bus master. */
+
+bool pci_find_class (int class, int subclass, struct pci_dev *);
+uint32_t pci_read_config (const struct pci_dev *, int reg);
+void pci_write_config (const struct pci_dev *, int reg, uint32_t);
+
+#endif /* devices/pci.h */
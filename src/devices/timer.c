@@ -17,6 +17,13 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
+/* 8254 input frequency. */
+#define PIT_HZ 1193180
+
+/* 8254 counter 0 reload value: PIT_HZ divided by TIMER_FREQ,
+   rounded to nearest. */
+#define PIT_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
@@ -35,9 +42,7 @@ static void real_time_sleep (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
-  /* 8254 input frequency divided by TIMER_FREQ, rounded to
-     nearest. */
-  uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
+  uint16_t count = PIT_COUNT;
 
   outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
   outb (0x40, count & 0xff);
@@ -84,6 +89,27 @@ timer_ticks (void)
   return t;
 }
 
+/* Returns the number of microseconds since the OS booted, to the
+   resolution of the 8254's counter, about 1 us.  If a timer
+   interrupt is pending but not yet handled, the result can fall
+   short by up to a tick, so callers that subtract two values
+   should treat a negative difference as 0. */
+int64_t
+timer_usecs (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  int64_t t = ticks;
+  uint16_t count;
+
+  outb (0x43, 0x00);    /* CW: latch counter 0. */
+  count = inb (0x40);
+  count |= inb (0x40) << 8;
+  intr_set_level (old_level);
+
+  return (t * (1000 * 1000 / TIMER_FREQ)
+          + (int64_t) (PIT_COUNT - count) * 1000 * 1000 / PIT_HZ);
+}
+
 /* Returns the number of timer ticks elapsed since THEN, which
    should be a value once returned by timer_ticks(). */
 int64_t
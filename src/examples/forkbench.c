@@ -0,0 +1,46 @@
+/* forkbench.c
+
+   Measures the cost of fork followed by exit.  The process first
+   touches every page of a large array, so that there is a real
+   address space to duplicate, then forks the requested number of
+   children.  Each child writes to one page, forcing a single
+   copy-on-write fault, and exits at once.  Compare the kernel's
+   tick counts printed at shutdown across runs. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+/* Size of the array that each child inherits. */
+#define ARRAY_SIZE (256 * 1024)
+
+static char array[ARRAY_SIZE];
+
+int
+main (int argc, char *argv[]) 
+{
+  int forks = argc > 1 ? atoi (argv[1]) : 100;
+  int i;
+
+  for (i = 0; i < ARRAY_SIZE; i += 4096)
+    array[i] = 1;
+
+  for (i = 0; i < forks; i++) 
+    {
+      pid_t pid = fork ();
+      if (pid == 0) 
+        {
+          array[0] = 2;
+          exit (0);
+        }
+      else if (pid == PID_ERROR) 
+        {
+          printf ("forkbench: fork %d failed\n", i);
+          return EXIT_FAILURE;
+        }
+      wait (pid);
+    }
+
+  printf ("forkbench: %d forks of %d kB\n", forks, ARRAY_SIZE / 1024);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,373 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+
+/* Buffer cache.
+
+   Holds recently used sectors of the file system disk in
+   memory.  Reads and writes of file system sectors go through
+   the cache, and modified sectors are written back to disk only
+   when they are evicted or when the cache is flushed.
+
+   Each block has a pin count, protected by cache_lock, that
+   counts the threads using it.  A pinned block is never evicted,
+   so its sector does not change.  Each block also has its own
+   lock, held by the one thread at a time that reads or modifies
+   its data.  A thread only ever holds a block's lock while the
+   block is pinned, so an unpinned block's lock is always free. */
+
+/* Number of blocks in the cache. */
+#define CACHE_CNT 64
+
+/* Maximum number of consecutive sectors that cache_flush()
+   writes back with a single disk command. */
+#define FLUSH_RUN_MAX 16
+
+/* Sector number of a block that holds no sector. */
+#define INVALID_SECTOR ((disk_sector_t) -1)
+
+/* A cached sector. */
+struct cache_block 
+  {
+    disk_sector_t sector;               /* Cached sector or INVALID_SECTOR. */
+    int pin_cnt;                        /* Number of users. */
+    bool dirty;                         /* Modified since read from disk? */
+    bool accessed;                      /* Used since last clock sweep? */
+    struct lock lock;                   /* Protects DATA. */
+    uint8_t data[DISK_SECTOR_SIZE];     /* Sector contents. */
+  };
+
+static struct cache_block blocks[CACHE_CNT];
+static struct lock cache_lock;          /* Protects sector, pin_cnt. */
+static struct condition block_unpinned; /* Signaled when pin_cnt drops. */
+static size_t clock_hand;               /* Next block to consider evicting. */
+
+/* Staging area for cache_flush(). */
+static struct lock flush_lock;          /* Protects flush_buffer. */
+static uint8_t flush_buffer[FLUSH_RUN_MAX * DISK_SECTOR_SIZE];
+
+static struct cache_block *lookup (disk_sector_t);
+static struct cache_block *cache_get (disk_sector_t, bool read);
+static void cache_put (struct cache_block *, bool dirty);
+
+/* Initializes the buffer cache. */
+void
+cache_init (void) 
+{
+  struct cache_block *b;
+
+  lock_init (&cache_lock);
+  cond_init (&block_unpinned);
+  lock_init (&flush_lock);
+  for (b = blocks; b < blocks + CACHE_CNT; b++) 
+    {
+      b->sector = INVALID_SECTOR;
+      b->pin_cnt = 0;
+      b->dirty = false;
+      b->accessed = false;
+      lock_init (&b->lock);
+    }
+}
+
+/* Reads SIZE bytes starting at offset OFS within SECTOR into
+   BUFFER. */
+void
+cache_read (disk_sector_t sector, void *buffer, size_t ofs, size_t size) 
+{
+  struct cache_block *b;
+
+  ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+  b = cache_get (sector, true);
+  memcpy (buffer, b->data + ofs, size);
+  cache_put (b, false);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR starting at offset
+   OFS within the sector. */
+void
+cache_write (disk_sector_t sector, const void *buffer,
+             size_t ofs, size_t size) 
+{
+  struct cache_block *b;
+
+  ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+  b = cache_get (sector, size < DISK_SECTOR_SIZE);
+  memcpy (b->data + ofs, buffer, size);
+  cache_put (b, true);
+}
+
+/* Reads SECTOR into BUFFER.  If SECTOR is not in the cache, it
+   is read straight from disk without taking a cache block, so
+   that data the caller keeps elsewhere, such as in a page of a
+   memory-mapped file, is not buffered twice and does not push
+   other sectors out of the cache. */
+void
+cache_read_uncached (disk_sector_t sector, void *buffer) 
+{
+  bool cached;
+
+  /* A sector that is not in the cache is up to date on disk,
+     because evict() writes back a modified block before giving
+     it up. */
+  lock_acquire (&cache_lock);
+  cached = lookup (sector) != NULL;
+  lock_release (&cache_lock);
+
+  if (cached)
+    cache_read (sector, buffer, 0, DISK_SECTOR_SIZE);
+  else
+    disk_read (filesys_disk, sector, buffer);
+}
+
+/* Reads SIZE bytes starting at offset OFS within SECTOR into
+   BUFFER, but only if SECTOR is in the cache and no other thread
+   is using its block.  Returns true if successful, false without
+   waiting otherwise. */
+bool
+cache_try_read (disk_sector_t sector, void *buffer, size_t ofs, size_t size) 
+{
+  struct cache_block *b;
+
+  ASSERT (ofs + size <= DISK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  b = lookup (sector);
+  if (b == NULL || !lock_try_acquire (&b->lock)) 
+    {
+      lock_release (&cache_lock);
+      return false;
+    }
+  b->pin_cnt++;
+  lock_release (&cache_lock);
+
+  memcpy (buffer, b->data + ofs, size);
+  cache_put (b, false);
+  return true;
+}
+
+/* Pins SECTOR in the cache, reading it in if necessary, so that
+   it stays there, and is not written back by eviction, until a
+   matching call to cache_unpin(). */
+void
+cache_pin (disk_sector_t sector) 
+{
+  struct cache_block *b = cache_get (sector, true);
+  lock_release (&b->lock);
+}
+
+/* Releases a pin on SECTOR taken by cache_pin(). */
+void
+cache_unpin (disk_sector_t sector) 
+{
+  struct cache_block *b;
+
+  lock_acquire (&cache_lock);
+  b = lookup (sector);
+  ASSERT (b != NULL && b->pin_cnt > 0);
+  if (--b->pin_cnt == 0)
+    cond_signal (&block_unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Orders cache blocks A and B by sector number. */
+static int
+compare_sectors (const void *a_, const void *b_) 
+{
+  const struct cache_block *a = *(struct cache_block *const *) a_;
+  const struct cache_block *b = *(struct cache_block *const *) b_;
+
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Writes all of the modified blocks in the cache to disk.
+   Modified blocks that hold consecutive sectors are written back
+   together with a single disk command. */
+void
+cache_flush (void) 
+{
+  struct cache_block *dirty[CACHE_CNT];
+  size_t dirty_cnt;
+  size_t i;
+
+  /* Pin every modified block, so that its sector cannot change,
+     and sort them by sector. */
+  lock_acquire (&cache_lock);
+  dirty_cnt = 0;
+  for (i = 0; i < CACHE_CNT; i++)
+    if (blocks[i].dirty) 
+      {
+        blocks[i].pin_cnt++;
+        dirty[dirty_cnt++] = &blocks[i];
+      }
+  lock_release (&cache_lock);
+  qsort (dirty, dirty_cnt, sizeof *dirty, compare_sectors);
+
+  lock_acquire (&flush_lock);
+  for (i = 0; i < dirty_cnt; ) 
+    {
+      size_t run_cnt, j;
+
+      /* Copy a run of consecutive sectors into flush_buffer.  A
+         block that has been written back by eviction in the
+         meantime is clean, so writing it again is harmless. */
+      for (run_cnt = 1; run_cnt < FLUSH_RUN_MAX && i + run_cnt < dirty_cnt;
+           run_cnt++)
+        if (dirty[i + run_cnt]->sector != dirty[i]->sector + run_cnt)
+          break;
+      for (j = 0; j < run_cnt; j++) 
+        {
+          struct cache_block *b = dirty[i + j];
+          lock_acquire (&b->lock);
+          memcpy (flush_buffer + j * DISK_SECTOR_SIZE, b->data,
+                  DISK_SECTOR_SIZE);
+          b->dirty = false;
+          lock_release (&b->lock);
+        }
+
+      /* The blocks stay pinned until the write is done, so that
+         no one reads their sectors from disk before then. */
+      disk_write_multiple (filesys_disk, dirty[i]->sector, run_cnt,
+                           flush_buffer);
+
+      lock_acquire (&cache_lock);
+      for (j = 0; j < run_cnt; j++)
+        if (--dirty[i + j]->pin_cnt == 0)
+          cond_signal (&block_unpinned, &cache_lock);
+      lock_release (&cache_lock);
+      i += run_cnt;
+    }
+  lock_release (&flush_lock);
+}
+
+/* Returns the block that holds SECTOR, or a null pointer
+   if no block holds it.  The caller must hold cache_lock. */
+static struct cache_block *
+lookup (disk_sector_t sector) 
+{
+  struct cache_block *b;
+
+  for (b = blocks; b < blocks + CACHE_CNT; b++)
+    if (b->sector == sector)
+      return b;
+  return NULL;
+}
+
+/* Writes modified block B back to disk, without holding
+   cache_lock during the write, so that other threads' cache hits
+   do not wait for it.  B stays pinned meanwhile, so that its
+   sector does not change.  The caller must hold cache_lock. */
+static void
+write_back (struct cache_block *b) 
+{
+  b->pin_cnt++;
+  lock_release (&cache_lock);
+
+  lock_acquire (&b->lock);
+  disk_write (filesys_disk, b->sector, b->data);
+  b->dirty = false;
+  lock_release (&b->lock);
+
+  lock_acquire (&cache_lock);
+  if (--b->pin_cnt == 0)
+    cond_signal (&block_unpinned, &cache_lock);
+}
+
+/* Chooses an unpinned block to hold a new sector with the clock
+   algorithm.  If the block is clean, returns it, without having
+   released cache_lock.  Otherwise, writes it back, or waits for
+   a block to be unpinned if every block is pinned, and returns a
+   null pointer: cache_lock was released meanwhile, so the caller
+   must check again whether its sector has been brought into the
+   cache, then try again.  The caller must hold cache_lock. */
+static struct cache_block *
+evict (void) 
+{
+  size_t i;
+
+  for (i = 0; i < 2 * CACHE_CNT; i++) 
+    {
+      struct cache_block *b = &blocks[clock_hand];
+      size_t hand = clock_hand;
+
+      clock_hand = (clock_hand + 1) % CACHE_CNT;
+      if (b->pin_cnt > 0)
+        continue;
+      else if (b->accessed)
+        b->accessed = false;
+      else if (!b->dirty)
+        return b;
+      else 
+        {
+          /* Consider B first on the next try.  It will still be
+             clean then, unless someone used it in the
+             meantime. */
+          write_back (b);
+          clock_hand = hand;
+          return NULL;
+        }
+    }
+  cond_wait (&block_unpinned, &cache_lock);
+  return NULL;
+}
+
+/* Returns the block that holds SECTOR, pinned and with its lock
+   held, bringing the sector into the cache if necessary.  If READ
+   is false, the caller is going to overwrite the whole sector, so
+   it is not read from disk. */
+static struct cache_block *
+cache_get (disk_sector_t sector, bool read) 
+{
+  struct cache_block *b;
+
+  ASSERT (sector != INVALID_SECTOR);
+
+  lock_acquire (&cache_lock);
+  for (;;) 
+    {
+      b = lookup (sector);
+      if (b != NULL) 
+        {
+          b->pin_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&b->lock);
+          return b;
+        }
+
+      b = evict ();
+      if (b != NULL)
+        break;
+    }
+
+  /* Claim the block.  Threads that look up SECTOR before we
+     finish reading it will wait for its lock. */
+  b->sector = sector;
+  b->pin_cnt = 1;
+  lock_acquire (&b->lock);
+  lock_release (&cache_lock);
+
+  if (read)
+    disk_read (filesys_disk, sector, b->data);
+  return b;
+}
+
+/* Releases block B, which was obtained with cache_get().  If
+   DIRTY is true, marks B as modified. */
+static void
+cache_put (struct cache_block *b, bool dirty) 
+{
+  b->accessed = true;
+  if (dirty)
+    b->dirty = true;
+  lock_release (&b->lock);
+
+  lock_acquire (&cache_lock);
+  if (--b->pin_cnt == 0)
+    cond_signal (&block_unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
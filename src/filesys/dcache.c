@@ -0,0 +1,231 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Maps a (directory inode sector, name) pair to the sector of
+   the inode that the name refers to, so that resolving a name
+   that was recently resolved does not have to read any
+   directory sectors.  An entry whose inode sector is 0 is a
+   negative entry: it records that the directory has no entry
+   by that name.  (Sector 0 holds the free map inode, which is
+   never in a directory.)
+
+   The cache is kept coherent by dir_add() and dir_remove(),
+   which update it whenever they change a directory.  When it
+   fills up, the least recently used entry is discarded.
+
+   dir_lookup() also fills the cache with the result of each
+   search of a directory on disk.  Such a result can be stale by
+   the time it is inserted, if dir_add() or dir_remove() changed
+   the directory in the meantime, so every update by them bumps a
+   generation number, and a fill is dropped if the generation has
+   changed since the search began. */
+
+/* Maximum number of cached entries. */
+#define DCACHE_MAX 256
+
+/* A cached directory entry. */
+struct dcache_entry 
+  {
+    struct hash_elem hash_elem;         /* Element in `dcache'. */
+    struct list_elem lru_elem;          /* Element in `lru_list'. */
+    disk_sector_t dir_sector;           /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    disk_sector_t inode_sector;         /* File's inode sector, or 0. */
+  };
+
+static struct hash dcache;      /* Cached entries. */
+static struct list lru_list;    /* Cached entries, most recently used first. */
+static unsigned generation;     /* Bumped by every update. */
+static struct lock dcache_lock; /* Protects all of the above. */
+
+static hash_hash_func dcache_hash;
+static hash_less_func dcache_less;
+static struct dcache_entry *find (disk_sector_t dir_sector,
+                                  const char *name);
+static void insert (disk_sector_t dir_sector, const char *name,
+                    disk_sector_t inode_sector);
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void) 
+{
+  if (!hash_init (&dcache, dcache_hash, dcache_less, NULL))
+    PANIC ("can't initialize directory entry cache");
+  list_init (&lru_list);
+  lock_init (&dcache_lock);
+}
+
+/* Looks up NAME in the directory whose inode is in DIR_SECTOR.
+   Returns false if the cache has no information about NAME.
+   Otherwise, returns true and stores into *INODE_SECTOR the
+   sector of NAME's inode, or 0 if the directory is known to
+   have no entry named NAME. */
+bool
+dcache_lookup (disk_sector_t dir_sector, const char *name,
+               disk_sector_t *inode_sector) 
+{
+  struct dcache_entry *e;
+
+  lock_acquire (&dcache_lock);
+  e = find (dir_sector, name);
+  if (e != NULL) 
+    {
+      list_remove (&e->lru_elem);
+      list_push_front (&lru_list, &e->lru_elem);
+      *inode_sector = e->inode_sector;
+    }
+  lock_release (&dcache_lock);
+
+  return e != NULL;
+}
+
+/* Records that NAME, in the directory whose inode is in
+   DIR_SECTOR, refers to the inode in INODE_SECTOR, or that there
+   is no such entry if INODE_SECTOR is 0.  For use by code that
+   has just changed the directory. */
+void
+dcache_insert (disk_sector_t dir_sector, const char *name,
+               disk_sector_t inode_sector) 
+{
+  lock_acquire (&dcache_lock);
+  generation++;
+  insert (dir_sector, name, inode_sector);
+  lock_release (&dcache_lock);
+}
+
+/* Returns the current generation number, for passing to
+   dcache_fill() after searching a directory. */
+unsigned
+dcache_generation (void) 
+{
+  unsigned g;
+
+  lock_acquire (&dcache_lock);
+  g = generation;
+  lock_release (&dcache_lock);
+  return g;
+}
+
+/* Like dcache_insert(), but for recording the result of a
+   search of the directory that began when the generation number
+   was GEN.  Does nothing if the cache has been updated since
+   then, because the result may be stale. */
+void
+dcache_fill (disk_sector_t dir_sector, const char *name,
+             disk_sector_t inode_sector, unsigned gen) 
+{
+  lock_acquire (&dcache_lock);
+  if (gen == generation)
+    insert (dir_sector, name, inode_sector);
+  lock_release (&dcache_lock);
+}
+
+/* Discards all of the cached entries for the directory whose
+   inode is in DIR_SECTOR, e.g. because the directory has been
+   removed and its sector may be reused. */
+void
+dcache_purge (disk_sector_t dir_sector) 
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&dcache_lock);
+  generation++;
+  for (e = list_begin (&lru_list); e != list_end (&lru_list); e = next) 
+    {
+      struct dcache_entry *de = list_entry (e, struct dcache_entry,
+                                            lru_elem);
+      next = list_next (e);
+      if (de->dir_sector == dir_sector) 
+        {
+          list_remove (&de->lru_elem);
+          hash_delete (&dcache, &de->hash_elem);
+          free (de);
+        }
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Records NAME in DIR_SECTOR as referring to INODE_SECTOR.  The
+   caller must hold dcache_lock. */
+static void
+insert (disk_sector_t dir_sector, const char *name,
+        disk_sector_t inode_sector) 
+{
+  struct dcache_entry *e;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  e = find (dir_sector, name);
+  if (e != NULL)
+    list_remove (&e->lru_elem);
+  else 
+    {
+      if (hash_size (&dcache) >= DCACHE_MAX)
+        {
+          /* Recycle the least recently used entry. */
+          e = list_entry (list_pop_back (&lru_list),
+                          struct dcache_entry, lru_elem);
+          hash_delete (&dcache, &e->hash_elem);
+        }
+      else
+        e = malloc (sizeof *e);
+      if (e == NULL)
+        return;
+
+      e->dir_sector = dir_sector;
+      strlcpy (e->name, name, sizeof e->name);
+      hash_insert (&dcache, &e->hash_elem);
+    }
+  e->inode_sector = inode_sector;
+  list_push_front (&lru_list, &e->lru_elem);
+}
+
+/* Returns the cached entry for NAME in DIR_SECTOR, or a null
+   pointer if there is none.  The caller must hold
+   dcache_lock. */
+static struct dcache_entry *
+find (disk_sector_t dir_sector, const char *name) 
+{
+  struct dcache_entry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+
+  key.dir_sector = dir_sector;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dcache, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dcache_entry, hash_elem) : NULL;
+}
+
+/* Returns a hash value for dcache_entry E. */
+static unsigned
+dcache_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct dcache_entry *de = hash_entry (e, struct dcache_entry,
+                                              hash_elem);
+  return hash_string (de->name) ^ hash_int (de->dir_sector);
+}
+
+/* Returns true if dcache_entry A precedes dcache_entry B. */
+static bool
+dcache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED) 
+{
+  const struct dcache_entry *a = hash_entry (a_, struct dcache_entry,
+                                             hash_elem);
+  const struct dcache_entry *b = hash_entry (b_, struct dcache_entry,
+                                             hash_elem);
+  if (a->dir_sector != b->dir_sector)
+    return a->dir_sector < b->dir_sector;
+  return strcmp (a->name, b->name) < 0;
+}
@@ -0,0 +1,17 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+void dcache_init (void);
+bool dcache_lookup (disk_sector_t dir_sector, const char *name,
+                    disk_sector_t *);
+void dcache_insert (disk_sector_t dir_sector, const char *name,
+                    disk_sector_t);
+unsigned dcache_generation (void);
+void dcache_fill (disk_sector_t dir_sector, const char *name,
+                  disk_sector_t, unsigned gen);
+void dcache_purge (disk_sector_t dir_sector);
+
+#endif /* filesys/dcache.h */
@@ -1,9 +1,12 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 
 /* A directory. */
@@ -21,12 +24,186 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Directories come in two on-disk layouts.
+
+   A linear directory is just an array of struct dir_entry.
+   Looking up a name or finding a free slot scans the whole
+   array.  Directories written by older versions of the file
+   system have this layout, and we still read and update them.
+
+   A hashed directory is divided into pages, one per sector.
+   Page 0 holds a struct dir_header, and pages 1 onward hold
+   struct dir_buckets, one per bucket.  The bucket for a name is
+   chosen from the name's hash by linear hashing: the directory
+   has between 2**LEVEL and 2**(LEVEL+1) buckets, and whenever an
+   insertion leaves the directory more than 3/4 full, bucket SPLIT
+   is split into itself and a new bucket appended after the last
+   one.  A bucket that fills up before its turn to be split
+   continues in a chain of overflow pages, which are kept past
+   the largest possible array of buckets, in a region that the
+   file has sectors for only where it has overflow pages.
+
+   Since splits keep the chains short, a lookup reads the header
+   and a page or two, and an insertion writes a page or two,
+   plus at most one split, no matter how large the directory
+   grows.
+
+   The two layouts are told apart by the header's magic number,
+   which is too large to be the inode sector of a linear
+   directory's first entry. */
+
+/* Identifies a hashed directory. */
+#define DIR_MAGIC 0x44495248
+
+/* Number of directory entries in one page of a hashed
+   directory. */
+#define BUCKET_ENTRY_CNT ((DISK_SECTOR_SIZE - sizeof (uint32_t)) \
+                          / sizeof (struct dir_entry))
+
+/* Upper bound on LEVEL in a hashed directory.  Past it, buckets
+   are no longer split and only their chains grow. */
+#define MAX_LEVEL 12
+
+/* First overflow page in a hashed directory, just past the
+   largest possible array of buckets. */
+#define OVERFLOW_PAGE ((1u << MAX_LEVEL) + 1)
+
+/* Header of a hashed directory, stored in page 0. */
+struct dir_header 
+  {
+    unsigned magic;                     /* DIR_MAGIC. */
+    uint32_t level;                     /* Hash level. */
+    uint32_t split;                     /* Next bucket to split. */
+    uint32_t entry_cnt;                 /* Number of entries in use. */
+    uint32_t overflow_cnt;              /* Overflow pages ever used. */
+    uint32_t free_page;                 /* First unused overflow page,
+                                           or 0 if none. */
+  };
+
+/* A page of a hashed directory that holds entries: either a
+   bucket or one of the overflow pages chained to it.  An unused
+   overflow page is chained to the next unused one instead. */
+struct dir_bucket 
+  {
+    struct dir_entry entries[BUCKET_ENTRY_CNT]; /* Entries. */
+    uint32_t next;                      /* Next page in chain, or 0. */
+  };
+
+/* Returns the byte offset of page PAGE in a hashed directory. */
+static inline off_t
+page_ofs (uint32_t page) 
+{
+  return page * DISK_SECTOR_SIZE;
+}
+
+/* Returns the page that holds bucket BUCKET in a hashed
+   directory. */
+static inline uint32_t
+bucket_page (uint32_t bucket) 
+{
+  return bucket + 1;
+}
+
+/* Returns the number of buckets in a hashed directory with
+   header H. */
+static inline uint32_t
+bucket_cnt (const struct dir_header *h) 
+{
+  return (1u << h->level) + h->split;
+}
+
+/* Returns the bucket for a name with the given HASH in a hashed
+   directory with header H. */
+static uint32_t
+hash_to_bucket (const struct dir_header *h, unsigned hash) 
+{
+  uint32_t bucket = hash & ((1u << h->level) - 1);
+  if (bucket < h->split)
+    bucket = hash & ((2u << h->level) - 1);
+  return bucket;
+}
+
+/* Reads page PAGE of hashed directory DIR into *B.
+   Returns true if successful, false on failure. */
+static bool
+read_page (const struct dir *dir, uint32_t page, struct dir_bucket *b) 
+{
+  return (inode_read_at (dir->inode, b, sizeof *b, page_ofs (page))
+          == sizeof *b);
+}
+
+/* Writes *B to page PAGE of hashed directory DIR.
+   Returns true if successful, false on failure. */
+static bool
+write_page (struct dir *dir, uint32_t page, const struct dir_bucket *b) 
+{
+  return (inode_write_at (dir->inode, b, sizeof *b, page_ofs (page))
+          == sizeof *b);
+}
+
+/* Writes header H to hashed directory DIR.
+   Returns true if successful, false on failure. */
+static bool
+write_header (struct dir *dir, const struct dir_header *h) 
+{
+  return inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Takes an unused overflow page from hashed directory DIR, whose
+   header is H, updating H but not writing it back. */
+static uint32_t
+alloc_page (const struct dir *dir, struct dir_header *h) 
+{
+  struct dir_bucket b;
+  uint32_t page;
+
+  if (h->free_page != 0 && read_page (dir, h->free_page, &b)) 
+    {
+      page = h->free_page;
+      h->free_page = b.next;
+    }
+  else
+    page = OVERFLOW_PAGE + h->overflow_cnt++;
+  return page;
+}
+
+/* Reads DIR's header into *H.
+   Returns true if DIR is a hashed directory, false if it is a
+   linear directory. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h) 
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_MAGIC);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR.  Returns true if successful, false on failure.
+   The directory grows as needed, so ENTRY_CNT is only a hint. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) 
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_header h;
+  struct inode *inode;
+  bool success;
+
+  h.magic = DIR_MAGIC;
+  h.level = 0;
+  h.split = 0;
+  h.entry_cnt = 0;
+  h.overflow_cnt = 0;
+  h.free_page = 0;
+  while ((1u << h.level) * BUCKET_ENTRY_CNT < entry_cnt
+         && h.level < MAX_LEVEL)
+    h.level++;
+
+  if (!inode_create (sector, page_ofs (bucket_page (bucket_cnt (&h))), true))
+    return false;
+  inode = inode_open (sector);
+  success = (inode != NULL
+             && inode_write_at (inode, &h, sizeof h, 0) == sizeof h);
+  inode_close (inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -83,6 +260,48 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Searches the chain of pages of hashed directory DIR's BUCKET
+   for NAME.  If successful, returns true, sets *EP to the
+   directory entry if EP is non-null, and sets *OFSP to the byte
+   offset of the directory entry if OFSP is non-null.
+   Otherwise, returns false and ignores EP and OFSP. */
+static bool
+lookup_bucket (const struct dir *dir, uint32_t bucket, const char *name,
+               struct dir_entry *ep, off_t *ofsp) 
+{
+  struct dir_bucket *b;
+  uint32_t page;
+  bool found = false;
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
+  for (page = bucket_page (bucket); page != 0 && !found; page = b->next) 
+    {
+      size_t i;
+
+      if (!read_page (dir, page, b))
+        break;
+      for (i = 0; i < BUCKET_ENTRY_CNT; i++) 
+        {
+          struct dir_entry *e = &b->entries[i];
+          if (e->in_use && !strcmp (name, e->name))
+            {
+              if (ep != NULL)
+                *ep = *e;
+              if (ofsp != NULL)
+                *ofsp = page_ofs (page) + i * sizeof *e;
+              found = true;
+              break;
+            }
+        }
+    }
+  free (b);
+
+  return found;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -92,12 +311,17 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_header h;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (read_header (dir, &h))
+    return lookup_bucket (dir, hash_to_bucket (&h, hash_string (name)),
+                          name, ep, ofsp);
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -111,24 +335,228 @@ lookup (const struct dir *dir, const char *name,
   return false;
 }
 
+/* Writes the CNT entries in ENTRIES to the chain of pages of
+   hashed directory DIR that starts at page FIRST, taking any
+   overflow pages it needs from the *SPARE_CNT pages in SPARES
+   and then from the unused overflow pages of DIR, whose header
+   is H.  Updates H but does not write it back.
+   Returns true if successful, false on failure. */
+static bool
+write_chain (struct dir *dir, struct dir_header *h, uint32_t first,
+             const struct dir_entry *entries, size_t cnt,
+             const uint32_t *spares, size_t *spare_cnt) 
+{
+  struct dir_bucket *b;
+  uint32_t page = first;
+  bool success = false;
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
+  for (;;) 
+    {
+      size_t n = cnt < BUCKET_ENTRY_CNT ? cnt : BUCKET_ENTRY_CNT;
+
+      memset (b, 0, sizeof *b);
+      memcpy (b->entries, entries, n * sizeof *entries);
+      entries += n;
+      cnt -= n;
+      if (cnt > 0)
+        b->next = *spare_cnt > 0 ? spares[--*spare_cnt] : alloc_page (dir, h);
+      if (!write_page (dir, page, b))
+        goto done;
+      if (cnt == 0)
+        break;
+      page = b->next;
+    }
+  success = true;
+
+ done:
+  free (b);
+  return success;
+}
+
+/* Resizes the block at *P to SIZE bytes, as with realloc(),
+   updating *P.  Returns true if successful, false on failure,
+   leaving *P as it was. */
+static bool
+grow_array (void **p, size_t size) 
+{
+  void *q = realloc (*p, size);
+  if (q == NULL)
+    return false;
+  *p = q;
+  return true;
+}
+
+/* Splits bucket H->split of hashed directory DIR, whose header
+   is H, moving the entries that hash to the new bucket
+   2**H->level + H->split into that bucket, which is appended to
+   DIR's buckets.  Overflow pages that neither bucket needs any
+   longer become unused.  Updates H and writes it back to DIR.
+   Returns true if successful, false on failure. */
+static bool
+split_bucket (struct dir *dir, struct dir_header *h) 
+{
+  uint32_t old_bucket = h->split;
+  uint32_t new_bucket = (1u << h->level) + h->split;
+  unsigned mask = (2u << h->level) - 1;
+  struct dir_bucket *b;
+  struct dir_entry *old_entries = NULL, *new_entries = NULL;
+  uint32_t *spares = NULL;
+  size_t old_cnt = 0, new_cnt = 0, spare_cnt = 0, cap = 0;
+  uint32_t page;
+  bool success = false;
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
+  /* Read the old bucket's chain, sorting its entries into the two
+     buckets and remembering its overflow pages for reuse. */
+  for (page = bucket_page (old_bucket); page != 0; page = b->next) 
+    {
+      size_t i;
+
+      if (!read_page (dir, page, b))
+        goto done;
+
+      /* Make room for every entry in the page to go either way. */
+      cap += BUCKET_ENTRY_CNT;
+      if (!grow_array ((void **) &old_entries, cap * sizeof *old_entries)
+          || !grow_array ((void **) &new_entries, cap * sizeof *new_entries)
+          || !grow_array ((void **) &spares, cap * sizeof *spares))
+        goto done;
+      if (page != bucket_page (old_bucket))
+        spares[spare_cnt++] = page;
+
+      for (i = 0; i < BUCKET_ENTRY_CNT; i++) 
+        {
+          struct dir_entry *e = &b->entries[i];
+          if (!e->in_use)
+            continue;
+          if ((hash_string (e->name) & mask) == new_bucket)
+            new_entries[new_cnt++] = *e;
+          else
+            old_entries[old_cnt++] = *e;
+        }
+    }
+
+  /* Write the new bucket first: until the header is updated, it
+     is past the end of the buckets that lookups consider. */
+  if (!write_chain (dir, h, bucket_page (new_bucket), new_entries, new_cnt,
+                    spares, &spare_cnt)
+      || !write_chain (dir, h, bucket_page (old_bucket), old_entries, old_cnt,
+                       spares, &spare_cnt))
+    goto done;
+
+  /* Chain the overflow pages left over to the unused ones. */
+  while (spare_cnt > 0) 
+    {
+      page = spares[--spare_cnt];
+      memset (b, 0, sizeof *b);
+      b->next = h->free_page;
+      if (!write_page (dir, page, b))
+        goto done;
+      h->free_page = page;
+    }
+
+  if (++h->split == 1u << h->level)
+    {
+      h->level++;
+      h->split = 0;
+    }
+  success = write_header (dir, h);
+
+ done:
+  free (b);
+  free (old_entries);
+  free (new_entries);
+  free (spares);
+  return success;
+}
+
+/* Finds a free slot for NAME in hashed directory DIR, whose
+   header is H, adding an overflow page to the end of NAME's
+   bucket's chain if the chain is full, and stores its byte
+   offset into *OFSP.  Updates H but does not write it back.
+   Returns true if successful, false on failure. */
+static bool
+find_free_slot (struct dir *dir, struct dir_header *h, const char *name,
+                off_t *ofsp) 
+{
+  struct dir_bucket *b;
+  uint32_t page, new_page;
+  bool success = false;
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
+  page = bucket_page (hash_to_bucket (h, hash_string (name)));
+  for (;;) 
+    {
+      size_t i;
+
+      if (!read_page (dir, page, b))
+        goto done;
+      for (i = 0; i < BUCKET_ENTRY_CNT; i++)
+        if (!b->entries[i].in_use) 
+          {
+            *ofsp = page_ofs (page) + i * sizeof b->entries[i];
+            success = true;
+            goto done;
+          }
+      if (b->next == 0)
+        break;
+      page = b->next;
+    }
+
+  /* The chain is full.  Link a new, empty overflow page to its
+     end. */
+  new_page = alloc_page (dir, h);
+  b->next = new_page;
+  if (!write_page (dir, page, b))
+    goto done;
+  memset (b, 0, sizeof *b);
+  if (!write_page (dir, new_page, b))
+    goto done;
+  *ofsp = page_ofs (new_page);
+  success = true;
+
+ done:
+  free (b);
+  return success;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   Consults the directory entry cache first, and records the
+   result there on a miss, unless the directory changed while it
+   was being searched. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  disk_sector_t dir_sector;
+  disk_sector_t inode_sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  dir_sector = inode_get_inumber (dir->inode);
+  if (!dcache_lookup (dir_sector, name, &inode_sector)) 
+    {
+      unsigned gen = dcache_generation ();
+      inode_sector = lookup (dir, name, &e, NULL) ? e.inode_sector : 0;
+      dcache_fill (dir_sector, name, inode_sector, gen);
+    }
 
+  *inode = inode_sector != 0 ? inode_open (inode_sector) : NULL;
   return *inode != NULL;
 }
 
@@ -141,8 +569,11 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) 
 {
+  disk_sector_t dir_sector, cached_sector;
+  struct dir_header h;
   struct dir_entry e;
   off_t ofs;
+  bool hashed;
   bool success = false;
   
   ASSERT (dir != NULL);
@@ -152,27 +583,57 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  /* Check that NAME is not in use.  A negative entry in the
+     directory entry cache saves reading the directory. */
+  dir_sector = inode_get_inumber (dir->inode);
+  if (!dcache_lookup (dir_sector, name, &cached_sector))
+    cached_sector = lookup (dir, name, &e, NULL) ? e.inode_sector : 0;
+  if (cached_sector != 0)
     goto done;
 
   /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
+     In a hashed directory, that's a slot in NAME's bucket.
+     In a linear directory, if there are no free slots, then it
+     will be set to the current end-of-file.
      
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  hashed = read_header (dir, &h);
+  if (hashed)
+    {
+      if (!find_free_slot (dir, &h, name, &ofs))
+        goto done;
+    }
+  else
+    for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+         ofs += sizeof e) 
+      if (!e.in_use)
+        break;
 
   /* Write slot. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (success)
+    dcache_insert (dir_sector, name, inode_sector);
+
+  /* Count the entry in a hashed directory, and split one bucket if
+     the directory has grown too full.  The directory is already
+     consistent, so the split may go into a transaction of its
+     own.  A failed split only leaves chains longer. */
+  if (success && hashed) 
+    {
+      h.entry_cnt++;
+      success = write_header (dir, &h);
+      if (success && h.level < MAX_LEVEL
+          && h.entry_cnt > bucket_cnt (&h) * BUCKET_ENTRY_CNT * 3 / 4) 
+        {
+          journal_restart ();
+          split_bucket (dir, &h);
+        }
+    }
 
  done:
   return success;
@@ -184,6 +645,7 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_header h;
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
@@ -205,8 +667,17 @@ dir_remove (struct dir *dir, const char *name)
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  if (read_header (dir, &h)) 
+    {
+      h.entry_cnt--;
+      if (!write_header (dir, &h))
+        goto done;
+    }
 
-  /* Remove inode. */
+  /* Remove inode.  If it is a directory, its sector may be
+     reused, so forget about any entries cached for it. */
+  dcache_insert (inode_get_inumber (dir->inode), name, 0);
+  dcache_purge (e.inode_sector);
   inode_remove (inode);
   success = true;
 
@@ -215,14 +686,84 @@ dir_remove (struct dir *dir, const char *name)
   return success;
 }
 
+/* In a hashed directory, DIR->pos of a struct dir encodes a
+   bucket, the index of a page in that bucket's chain, and a slot
+   within the page, in the bits given by these macros. */
+#define POS_SLOT_BITS 5
+#define POS_PAGE_BITS 13
+#define POS_SLOT(POS) ((POS) & ((1 << POS_SLOT_BITS) - 1))
+#define POS_PAGE(POS) (((POS) >> POS_SLOT_BITS) & ((1 << POS_PAGE_BITS) - 1))
+#define POS_BUCKET(POS) ((POS) >> (POS_SLOT_BITS + POS_PAGE_BITS))
+#define MAKE_POS(BUCKET, PAGE, SLOT)                                    \
+        (((off_t) (BUCKET) << (POS_SLOT_BITS + POS_PAGE_BITS))          \
+         | ((PAGE) << POS_SLOT_BITS) | (SLOT))
+
+/* Reads the next entry in hashed directory DIR, whose header is
+   H, and stores the name in NAME.  Returns true if successful,
+   false if the directory contains no more entries. */
+static bool
+readdir_hashed (struct dir *dir, const struct dir_header *h,
+                char name[NAME_MAX + 1]) 
+{
+  struct dir_bucket *b;
+  bool found = false;
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
+  while (!found && (uint32_t) POS_BUCKET (dir->pos) < bucket_cnt (h)) 
+    {
+      uint32_t bucket = POS_BUCKET (dir->pos);
+      size_t idx = POS_PAGE (dir->pos);
+      size_t slot = POS_SLOT (dir->pos);
+      uint32_t page = bucket_page (bucket);
+      size_t i;
+
+      /* Find page IDX of the bucket's chain. */
+      for (i = 0; page != 0; i++, page = b->next) 
+        {
+          if (!read_page (dir, page, b))
+            goto done;
+          if (i == idx)
+            break;
+        }
+      if (page == 0 || idx >= (1 << POS_PAGE_BITS) - 1) 
+        {
+          dir->pos = MAKE_POS (bucket + 1, 0, 0);
+          continue;
+        }
+
+      for (; slot < BUCKET_ENTRY_CNT; slot++)
+        if (b->entries[slot].in_use) 
+          {
+            strlcpy (name, b->entries[slot].name, NAME_MAX + 1);
+            found = true;
+            slot++;
+            break;
+          }
+      dir->pos = (slot < BUCKET_ENTRY_CNT
+                  ? MAKE_POS (bucket, idx, slot)
+                  : MAKE_POS (bucket, idx + 1, 0));
+    }
+
+ done:
+  free (b);
+  return found;
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_header h;
   struct dir_entry e;
 
+  if (read_header (dir, &h))
+    return readdir_hashed (dir, &h, name);
+
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
@@ -2,15 +2,23 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
 #include "devices/disk.h"
 
 /* The disk that contains the file system. */
 struct disk *filesys_disk;
 
+/* If true, the file system is striped across hd0:1 and hd1:1
+   instead of occupying hd0:1 alone.
+   Controlled by the kernel command-line option "-stripe". */
+bool filesys_stripe;
+
 static void do_format (void);
 
 /* Initializes the file system module.
@@ -21,12 +29,24 @@ filesys_init (bool format)
   filesys_disk = disk_get (0, 1);
   if (filesys_disk == NULL)
     PANIC ("hd0:1 (hdb) not present, file system initialization failed");
+  if (filesys_stripe) 
+    {
+      struct disk *second = disk_get (1, 1);
+      if (second == NULL)
+        PANIC ("hd1:1 (hdd) not present, cannot stripe file system");
+      filesys_disk = disk_stripe (filesys_disk, second);
+    }
 
+  cache_init ();
+  journal_init ();
   inode_init ();
+  dcache_init ();
   free_map_init ();
 
   if (format) 
     do_format ();
+  else
+    journal_replay ();
 
   free_map_open ();
 }
@@ -36,7 +56,9 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  inode_flush_delayed ();
   free_map_close ();
+  journal_checkpoint ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -47,14 +69,25 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   disk_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  disk_sector_t cached_sector;
+  struct dir *dir;
+  bool success;
+
+  /* Fail fast if the directory entry cache knows NAME exists. */
+  if (dcache_lookup (ROOT_DIR_SECTOR, name, &cached_sector)
+      && cached_sector != 0)
+    return false;
+
+  journal_begin ();
+  dir = dir_open_root ();
+  success = (dir != NULL
+             && free_map_allocate (1, ROOT_DIR_SECTOR, &inode_sector)
+             && inode_create (inode_sector, initial_size, false)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  journal_end ();
 
   return success;
 }
@@ -67,9 +100,16 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  struct dir *dir;
   struct inode *inode = NULL;
+  disk_sector_t inode_sector;
 
+  /* On a hit in the directory entry cache, there is no need to
+     open the directory at all. */
+  if (dcache_lookup (ROOT_DIR_SECTOR, name, &inode_sector))
+    return inode_sector != 0 ? file_open (inode_open (inode_sector)) : NULL;
+
+  dir = dir_open_root ();
   if (dir != NULL)
     dir_lookup (dir, name, &inode);
   dir_close (dir);
@@ -84,9 +124,14 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = dir_open_root ();
+  success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
@@ -96,9 +141,11 @@ static void
 do_format (void)
 {
   printf ("Formatting file system...");
+  journal_format ();
   free_map_create ();
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
+  journal_checkpoint ();
   printf ("done.\n");
 }
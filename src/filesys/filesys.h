@@ -8,9 +8,15 @@
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
 
+/* First sector of the metadata journal. */
+#define JOURNAL_SECTOR 2
+
 /* Disk used for file system. */
 extern struct disk *filesys_disk;
 
+/* Stripe the file system across hd0:1 and hd1:1? */
+extern bool filesys_stripe;
+
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
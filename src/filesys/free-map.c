@@ -1,12 +1,41 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* The disk is divided into allocation groups of GROUP_SECTORS
+   sectors each, and we keep a count of the free sectors in each
+   group.  An allocation starts looking for free space at a goal
+   sector, e.g. just past the previous sector of the same file,
+   and moves on to the next group with enough free sectors,
+   skipping full groups without scanning their bits. */
+#define GROUP_SECTORS 512
+
+/* Number of free map bits stored in one sector of the free map
+   file. */
+#define BITS_PER_SECTOR (DISK_SECTOR_SIZE * 8)
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static size_t group_cnt;             /* Number of allocation groups. */
+static size_t *group_free_cnt;       /* Free sectors in each group. */
+static size_t free_cnt;              /* Free sectors on the whole disk. */
+static size_t reserved_cnt;          /* Free sectors promised to
+                                        delayed allocations. */
+static struct lock free_map_lock;    /* Protects all of the above. */
+
+static void count_free (void);
+static void adjust_free_cnt (disk_sector_t, size_t cnt, int sign);
+static disk_sector_t find_free (disk_sector_t goal, size_t cnt);
+static bool write_range (disk_sector_t, size_t cnt);
+static bool allocate (size_t cnt, disk_sector_t goal, bool reserved,
+                      disk_sector_t *);
 
 /* Initializes the free map. */
 void
@@ -15,37 +44,88 @@ free_map_init (void)
   free_map = bitmap_create (disk_size (filesys_disk));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--disk is too large");
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+  group_free_cnt = malloc (group_cnt * sizeof *group_free_cnt);
+  if (group_free_cnt == NULL)
+    PANIC ("allocation group creation failed");
+  lock_init (&free_map_lock);
+
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTOR_CNT, true);
+  count_free ();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  The sectors are placed at or after
+   GOAL if possible, preferring GOAL's allocation group.
+   Sectors reserved with free_map_reserve() are not available.
    Returns true if successful, false if all sectors were
-   available. */
+   available.
+
+   Only the parts of the free map file that change are written,
+   and they go through the buffer cache, so allocation does not
+   wait for the disk. */
 bool
-free_map_allocate (size_t cnt, disk_sector_t *sectorp) 
+free_map_allocate (size_t cnt, disk_sector_t goal, disk_sector_t *sectorp) 
 {
-  disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
-    {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
-    }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  return allocate (cnt, goal, false, sectorp);
+}
+
+/* Like free_map_allocate(), but takes the CNT sectors out of an
+   earlier reservation made with free_map_reserve().  On failure,
+   e.g. because no run of CNT consecutive sectors is free, the
+   reservation is left in place. */
+bool
+free_map_allocate_reserved (size_t cnt, disk_sector_t goal,
+                            disk_sector_t *sectorp) 
+{
+  return allocate (cnt, goal, true, sectorp);
+}
+
+/* Sets aside CNT free sectors, without choosing which, so that
+   a later free_map_allocate_reserved() of those sectors cannot
+   fail for lack of space.  Returns true if successful, false if
+   fewer than CNT unreserved sectors are free. */
+bool
+free_map_reserve (size_t cnt) 
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = free_cnt - reserved_cnt >= cnt;
+  if (success)
+    reserved_cnt += cnt;
+  lock_release (&free_map_lock);
+
+  return success;
+}
+
+/* Gives back CNT sectors reserved with free_map_reserve(). */
+void
+free_map_unreserve (size_t cnt) 
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (reserved_cnt >= cnt);
+  reserved_cnt -= cnt;
+  lock_release (&free_map_lock);
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt)
 {
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    journal_revoke (sector + i);
+
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  adjust_free_cnt (sector, cnt, +1);
+  write_range (sector, cnt);
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -57,13 +137,16 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  count_free ();
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Closes the free map file.  Its modified sectors stay in the
+   buffer cache until they are flushed. */
 void
 free_map_close (void) 
 {
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -71,14 +154,167 @@ free_map_close (void)
 void
 free_map_create (void) 
 {
+  struct inode *inode;
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), true))
     PANIC ("free map creation failed");
 
+  /* Give the file all of its sectors while free_map_file is still
+     null, so that writing the bitmap never has to allocate a
+     sector, which would write the free map from inside a write to
+     it. */
+  inode = inode_open (FREE_MAP_SECTOR);
+  if (inode == NULL
+      || !inode_preallocate (inode, bitmap_file_size (free_map)))
+    PANIC ("can't allocate free map");
+
   /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
+  free_map_file = file_open (inode);
   if (free_map_file == NULL)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
+
+/* Allocates CNT consecutive sectors near GOAL and stores the
+   first into *SECTORP, taking them from the reservation if
+   RESERVED is true or from the unreserved free sectors
+   otherwise.  Returns true if successful. */
+static bool
+allocate (size_t cnt, disk_sector_t goal, bool reserved,
+          disk_sector_t *sectorp) 
+{
+  disk_sector_t sector = BITMAP_ERROR;
+
+  lock_acquire (&free_map_lock);
+  ASSERT (!reserved || reserved_cnt >= cnt);
+  if (reserved || free_cnt - reserved_cnt >= cnt)
+    sector = find_free (goal, cnt);
+  if (sector != BITMAP_ERROR) 
+    {
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      if (!write_range (sector, cnt)) 
+        {
+          bitmap_set_multiple (free_map, sector, cnt, false); 
+          sector = BITMAP_ERROR;
+        }
+      else 
+        {
+          adjust_free_cnt (sector, cnt, -1);
+          if (reserved)
+            reserved_cnt -= cnt;
+        }
+    }
+  lock_release (&free_map_lock);
+
+  if (sector != BITMAP_ERROR)
+    *sectorp = sector;
+  return sector != BITMAP_ERROR;
+}
+
+/* Recomputes the free sector count of every allocation group,
+   and of the whole disk, from the free map. */
+static void
+count_free (void) 
+{
+  size_t group;
+
+  free_cnt = 0;
+  for (group = 0; group < group_cnt; group++) 
+    {
+      size_t start = group * GROUP_SECTORS;
+      size_t end = start + GROUP_SECTORS;
+      if (end > bitmap_size (free_map))
+        end = bitmap_size (free_map);
+      group_free_cnt[group] = bitmap_count (free_map, start, end - start,
+                                            false);
+      free_cnt += group_free_cnt[group];
+    }
+}
+
+/* Adds SIGN (+1 or -1) times the number of sectors in the range
+   of CNT sectors starting at SECTOR to the free counts of the
+   allocation groups that the range overlaps, and to the total. */
+static void
+adjust_free_cnt (disk_sector_t sector, size_t cnt, int sign) 
+{
+  while (cnt > 0) 
+    {
+      size_t group = sector / GROUP_SECTORS;
+      size_t group_left = (group + 1) * GROUP_SECTORS - sector;
+      size_t n = cnt < group_left ? cnt : group_left;
+
+      group_free_cnt[group] += sign * (int) n;
+      free_cnt += sign * (int) n;
+      sector += n;
+      cnt -= n;
+    }
+}
+
+/* Returns the first sector of a run of CNT free sectors within
+   [START, END), or BITMAP_ERROR if there is no such run. */
+static disk_sector_t
+scan_range (size_t start, size_t end, size_t cnt) 
+{
+  size_t sector, run = 0;
+
+  if (end > bitmap_size (free_map))
+    end = bitmap_size (free_map);
+  for (sector = start; sector < end; sector++)
+    if (bitmap_test (free_map, sector))
+      run = 0;
+    else if (++run == cnt)
+      return sector + 1 - cnt;
+  return BITMAP_ERROR;
+}
+
+/* Returns the first sector of a run of CNT free sectors, at or
+   after GOAL if possible, or BITMAP_ERROR if there is no such
+   run. */
+static disk_sector_t
+find_free (disk_sector_t goal, size_t cnt) 
+{
+  size_t group, i;
+
+  if (goal >= bitmap_size (free_map))
+    goal = 0;
+
+  /* Try GOAL's group, starting from GOAL, then the following
+     groups in order, skipping those without enough free
+     sectors. */
+  group = goal / GROUP_SECTORS;
+  for (i = 0; i < group_cnt; i++, group = (group + 1) % group_cnt) 
+    if (group_free_cnt[group] >= cnt) 
+      {
+        size_t start = i == 0 ? goal : group * GROUP_SECTORS;
+        size_t end = (group + 1) * GROUP_SECTORS;
+        size_t sector = scan_range (start, end, cnt);
+        if (sector != BITMAP_ERROR)
+          return sector;
+      }
+
+  /* Fall back to runs that span groups, or that lie before GOAL
+     in its own group. */
+  return bitmap_scan (free_map, 0, cnt, false);
+}
+
+/* Writes the sectors of the free map file that hold the bits for
+   the CNT sectors starting at SECTOR.  Does nothing if the free
+   map file is not open yet.
+   Returns true if successful, false otherwise. */
+static bool
+write_range (disk_sector_t sector, size_t cnt) 
+{
+  size_t start, end;
+
+  if (free_map_file == NULL)
+    return true;
+
+  /* Round out to whole sectors of the free map file. */
+  start = ROUND_DOWN (sector, BITS_PER_SECTOR);
+  end = ROUND_UP (sector + cnt, BITS_PER_SECTOR);
+  if (end > bitmap_size (free_map))
+    end = bitmap_size (free_map);
+  return bitmap_write_range (free_map, free_map_file, start, end - start);
+}
@@ -11,7 +11,11 @@ void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
 
-bool free_map_allocate (size_t, disk_sector_t *);
+bool free_map_allocate (size_t, disk_sector_t goal, disk_sector_t *);
+bool free_map_allocate_reserved (size_t, disk_sector_t goal,
+                                 disk_sector_t *);
+bool free_map_reserve (size_t);
+void free_map_unreserve (size_t);
 void free_map_release (disk_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
@@ -1,16 +1,29 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <random.h>
+#include <round.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "devices/disk.h"
+#include "devices/elevator.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
+/* Number of sectors that fsutil_put() and fsutil_get() transfer
+   to or from the scratch disk with each disk command. */
+#define CHUNK_SECTORS 64
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED) 
@@ -66,6 +79,182 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Prints how many extents, or runs of consecutive disk sectors,
+   file ARGV[1] occupies, then reads it back and prints how long
+   that took. */
+void
+fsutil_extents (char **argv) 
+{
+  const char *file_name = argv[1];
+  struct file *file;
+  void *buffer;
+  int64_t start;
+  off_t size;
+
+  file = filesys_open (file_name);
+  if (file == NULL)
+    PANIC ("%s: open failed", file_name);
+  size = file_length (file);
+  printf ("%s: %"PROTd" bytes in %zu extents\n", file_name, size,
+          inode_extent_cnt (file_get_inode (file)));
+
+  buffer = palloc_get_page (PAL_ASSERT);
+  start = timer_ticks ();
+  while (file_read (file, buffer, PGSIZE) > 0)
+    continue;
+  printf ("%s: read back in %"PRId64" ticks\n", file_name,
+          timer_elapsed (start));
+  palloc_free_page (buffer);
+  file_close (file);
+}
+
+/* fsutil_iobench() parameters. */
+#define BENCH_THREADS 8                 /* Number of reader threads. */
+#define BENCH_READS 128                 /* Reads per thread. */
+#define BENCH_SECTORS 8                 /* Sectors per read. */
+
+/* fsutil_iobench() state. */
+static int64_t bench_latency[BENCH_THREADS * BENCH_READS];
+static struct semaphore bench_done;
+
+/* fsutil_iobench() reader thread.  Reads BENCH_READS random
+   blocks from the file system disk and records how many
+   microseconds each took in the BENCH_READS entries of
+   bench_latency starting at LATENCY.  A read usually takes much
+   less than a timer tick, so ticks are too coarse for this. */
+static void
+bench_reader (void *latency_) 
+{
+  int64_t *latency = latency_;
+  disk_sector_t block_cnt = disk_size (filesys_disk) / BENCH_SECTORS;
+  void *buffer = palloc_get_page (PAL_ASSERT);
+  int i;
+
+  for (i = 0; i < BENCH_READS; i++) 
+    {
+      disk_sector_t block = random_ulong () % block_cnt;
+      int64_t start = timer_usecs ();
+      disk_read_multiple (filesys_disk, block * BENCH_SECTORS, BENCH_SECTORS,
+                          buffer);
+      latency[i] = timer_usecs () - start;
+      if (latency[i] < 0)
+        latency[i] = 0;
+    }
+  palloc_free_page (buffer);
+  sema_up (&bench_done);
+}
+
+/* Orders latencies A and B. */
+static int
+compare_latencies (const void *a_, const void *b_) 
+{
+  const int64_t *a = a_;
+  const int64_t *b = b_;
+
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Has several threads read random blocks from the file system
+   disk at the same time, bypassing the buffer cache, and prints
+   their aggregate throughput and the 99th percentile latency of
+   their reads.  Run with and without "-fifo" to compare disk
+   request scheduling with and without the elevator. */
+void
+fsutil_iobench (char **argv UNUSED) 
+{
+  const int read_cnt = BENCH_THREADS * BENCH_READS;
+  int64_t start, elapsed;
+  int i;
+
+  sema_init (&bench_done, 0);
+  start = timer_ticks ();
+  for (i = 0; i < BENCH_THREADS; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "iobench %d", i);
+      thread_create (name, PRI_DEFAULT, bench_reader,
+                     bench_latency + i * BENCH_READS);
+    }
+  for (i = 0; i < BENCH_THREADS; i++)
+    sema_down (&bench_done);
+  elapsed = timer_elapsed (start);
+  if (elapsed == 0)
+    elapsed = 1;
+
+  qsort (bench_latency, read_cnt, sizeof *bench_latency, compare_latencies);
+  printf ("iobench: %d threads read %d blocks of %d bytes "
+          "in %"PRId64" ticks (%s)\n",
+          BENCH_THREADS, read_cnt, BENCH_SECTORS * DISK_SECTOR_SIZE, elapsed,
+          elevator_fifo ? "fifo" : "elevator");
+  printf ("iobench: %"PRId64" kB/s, p99 latency %"PRId64" us\n",
+          ((int64_t) read_cnt * BENCH_SECTORS * DISK_SECTOR_SIZE / 1024
+           * TIMER_FREQ / elapsed),
+          bench_latency[read_cnt * 99 / 100]);
+}
+
+/* Next sector to read on the scratch disk, for fsutil_put() and
+   fsutil_extract(). */
+static disk_sector_t put_sector;
+
+/* Opens the scratch disk, reads the "PUT" header at put_sector,
+   which must describe a file for NAME, and advances past it.
+   Stores the size of the data that follows into *SIZE and returns
+   the scratch disk. */
+static struct disk *
+read_put_header (const char *name, off_t *size, void *buffer) 
+{
+  struct disk *src;
+
+  src = disk_get (1, 0);
+  if (src == NULL)
+    PANIC ("couldn't open source disk (hdc or hd1:0)");
+
+  disk_read (src, put_sector++, buffer);
+  if (memcmp (buffer, "PUT", 4))
+    PANIC ("%s: missing PUT signature on scratch disk", name);
+  *size = ((int32_t *) buffer)[1];
+  if (*size < 0)
+    PANIC ("%s: invalid file size %d", name, *size);
+  return src;
+}
+
+/* Creates file FILE_NAME, SIZE bytes long, and copies its data
+   from SRC starting at put_sector, advancing put_sector past it.
+   The file's sectors are allocated up front, so that it is
+   stored in as few extents as possible, and the data is read
+   CHUNK_SECTORS sectors at a time into BUFFER. */
+static void
+import_file (struct disk *src, const char *file_name, off_t size,
+             void *buffer) 
+{
+  struct file *dst;
+
+  /* Create destination file. */
+  if (!filesys_create (file_name, size))
+    PANIC ("%s: create failed", file_name);
+  dst = filesys_open (file_name);
+  if (dst == NULL)
+    PANIC ("%s: open failed", file_name);
+  if (!inode_preallocate (file_get_inode (dst), size))
+    PANIC ("%s: out of disk space", file_name);
+
+  /* Do copy. */
+  while (size > 0)
+    {
+      int chunk_size = (size > CHUNK_SECTORS * DISK_SECTOR_SIZE
+                        ? CHUNK_SECTORS * DISK_SECTOR_SIZE : size);
+      size_t sector_cnt = DIV_ROUND_UP (chunk_size, DISK_SECTOR_SIZE);
+      disk_read_multiple (src, put_sector, sector_cnt, buffer);
+      put_sector += sector_cnt;
+      if (file_write (dst, buffer, chunk_size) != chunk_size)
+        PANIC ("%s: write failed with %"PROTd" bytes unwritten",
+               file_name, size);
+      size -= chunk_size;
+    }
+
+  file_close (dst);
+}
+
 /* Copies from the "scratch" disk, hdc or hd1:0 to file ARGV[1]
    in the file system.
 
@@ -81,54 +270,159 @@ fsutil_rm (char **argv)
 void
 fsutil_put (char **argv) 
 {
-  static disk_sector_t sector = 0;
-
   const char *file_name = argv[1];
   struct disk *src;
-  struct file *dst;
   off_t size;
   void *buffer;
 
   printf ("Putting '%s' into the file system...\n", file_name);
 
   /* Allocate buffer. */
-  buffer = malloc (DISK_SECTOR_SIZE);
+  buffer = malloc (CHUNK_SECTORS * DISK_SECTOR_SIZE);
   if (buffer == NULL)
     PANIC ("couldn't allocate buffer");
 
-  /* Open source disk and read file size. */
-  src = disk_get (1, 0);
-  if (src == NULL)
-    PANIC ("couldn't open source disk (hdc or hd1:0)");
+  src = read_put_header (file_name, &size, buffer);
+  import_file (src, file_name, size, buffer);
+  free (buffer);
+}
 
-  /* Read file size. */
-  disk_read (src, sector++, buffer);
-  if (memcmp (buffer, "PUT", 4))
-    PANIC ("%s: missing PUT signature on scratch disk", file_name);
-  size = ((int32_t *) buffer)[1];
-  if (size < 0)
-    PANIC ("%s: invalid file size %d", file_name, size);
-  
-  /* Create destination file. */
-  if (!filesys_create (file_name, size))
-    PANIC ("%s: create failed", file_name);
-  dst = filesys_open (file_name);
-  if (dst == NULL)
-    PANIC ("%s: open failed", file_name);
+/* Header of a file in a ustar archive, as written by tar.
+   Numbers are in ASCII octal. */
+struct ustar_header
+  {
+    char name[100];             /* File name. */
+    char mode[8];               /* Permissions. */
+    char uid[8];                /* Owner. */
+    char gid[8];                /* Group. */
+    char size[12];              /* File size in bytes. */
+    char mtime[12];             /* Modification time. */
+    char chksum[8];             /* Sum of header bytes. */
+    char typeflag;              /* '0' or '\0' for a regular file. */
+    char linkname[100];         /* Link target. */
+    char magic[6];              /* "ustar\0". */
+    char version[2];            /* "00". */
+    char uname[32];             /* Owner name. */
+    char gname[32];             /* Group name. */
+    char devmajor[8];           /* Device numbers. */
+    char devminor[8];
+    char prefix[155];           /* Directory of NAME. */
+    char padding[12];
+  };
 
-  /* Do copy. */
-  while (size > 0)
+/* Parses the SIZE-byte ASCII octal number in S, which may be
+   padded with spaces or null characters, into *VALUE.  Returns
+   true if successful, false if S is not a valid number. */
+static bool
+parse_octal (const char *s, size_t size, unsigned long *value) 
+{
+  size_t i = 0;
+
+  while (i < size && s[i] == ' ')
+    i++;
+  *value = 0;
+  for (; i < size && s[i] >= '0' && s[i] <= '7'; i++)
     {
-      int chunk_size = size > DISK_SECTOR_SIZE ? DISK_SECTOR_SIZE : size;
-      disk_read (src, sector++, buffer);
-      if (file_write (dst, buffer, chunk_size) != chunk_size)
-        PANIC ("%s: write failed with %"PROTd" bytes unwritten",
-               file_name, size);
-      size -= chunk_size;
+      if (*value > (unsigned long) INT32_MAX / 8)
+        return false;
+      *value = *value * 8 + (s[i] - '0');
     }
+  for (; i < size; i++)
+    if (s[i] != ' ' && s[i] != '\0')
+      return false;
+  return true;
+}
 
-  /* Finish up. */
-  file_close (dst);
+/* Returns true if H is a well-formed ustar header. */
+static bool
+ustar_header_valid (const struct ustar_header *h) 
+{
+  const uint8_t *p = (const uint8_t *) h;
+  unsigned long chksum, sum = 0;
+  size_t i;
+
+  if (memcmp (h->magic, "ustar", 5) || !parse_octal (h->chksum,
+                                                     sizeof h->chksum,
+                                                     &chksum))
+    return false;
+  for (i = 0; i < sizeof *h; i++)
+    if (i >= offsetof (struct ustar_header, chksum)
+        && i < offsetof (struct ustar_header, chksum) + sizeof h->chksum)
+      sum += ' ';
+    else
+      sum += p[i];
+  return sum == chksum;
+}
+
+/* Extracts the files in the ustar archive that fsutil_put() would
+   otherwise copy from the scratch disk as a single file, so that
+   many files can be imported with one action.  Only regular files
+   whose names fit in a single component of at most NAME_MAX
+   characters are extracted; other entries are skipped with a
+   warning. */
+void
+fsutil_extract (char **argv UNUSED) 
+{
+  struct ustar_header *h;
+  disk_sector_t archive_end;
+  struct disk *src;
+  off_t size;
+  void *buffer;
+
+  printf ("Extracting archive into the file system...\n");
+
+  /* Allocate buffer. */
+  buffer = malloc (CHUNK_SECTORS * DISK_SECTOR_SIZE);
+  if (buffer == NULL)
+    PANIC ("couldn't allocate buffer");
+  h = malloc (sizeof *h);
+  if (h == NULL)
+    PANIC ("couldn't allocate buffer");
+  ASSERT (sizeof *h == DISK_SECTOR_SIZE);
+
+  src = read_put_header ("archive", &size, buffer);
+  archive_end = put_sector + DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
+  while (put_sector < archive_end) 
+    {
+      unsigned long file_size;
+      char name[sizeof h->name + 1];
+      const char *base;
+
+      /* An all-zero header marks the end of the archive. */
+      disk_read (src, put_sector++, h);
+      if (h->name[0] == '\0')
+        break;
+      if (!ustar_header_valid (h)
+          || !parse_octal (h->size, sizeof h->size, &file_size))
+        PANIC ("corrupt archive header at sector %"PRDSNu, put_sector - 1);
+
+      /* Skip all but regular files in the top directory. */
+      strlcpy (name, h->name, sizeof name);
+      base = name;
+      if (!memcmp (base, "./", 2))
+        base += 2;
+      if ((h->typeflag != '0' && h->typeflag != '\0')
+          || h->prefix[0] != '\0' || strchr (base, '/') != NULL
+          || *base == '\0')
+        {
+          printf ("Skipping '%s'...\n", name);
+          put_sector += DIV_ROUND_UP (file_size, DISK_SECTOR_SIZE);
+          continue;
+        }
+      if (strlen (base) > NAME_MAX) 
+        {
+          printf ("Skipping '%s': name longer than %d characters.\n",
+                  name, NAME_MAX);
+          put_sector += DIV_ROUND_UP (file_size, DISK_SECTOR_SIZE);
+          continue;
+        }
+
+      printf ("Putting '%s' into the file system...\n", base);
+      import_file (src, base, file_size, buffer);
+    }
+  put_sector = archive_end;
+
+  free (h);
   free (buffer);
 }
 
@@ -157,7 +451,7 @@ fsutil_get (char **argv)
   printf ("Getting '%s' from the file system...\n", file_name);
 
   /* Allocate buffer. */
-  buffer = malloc (DISK_SECTOR_SIZE);
+  buffer = malloc (CHUNK_SECTORS * DISK_SECTOR_SIZE);
   if (buffer == NULL)
     PANIC ("couldn't allocate buffer");
 
@@ -181,13 +475,17 @@ fsutil_get (char **argv)
   /* Do copy. */
   while (size > 0) 
     {
-      int chunk_size = size > DISK_SECTOR_SIZE ? DISK_SECTOR_SIZE : size;
-      if (sector >= disk_size (dst))
+      int chunk_size = (size > CHUNK_SECTORS * DISK_SECTOR_SIZE
+                        ? CHUNK_SECTORS * DISK_SECTOR_SIZE : size);
+      size_t sector_cnt = DIV_ROUND_UP (chunk_size, DISK_SECTOR_SIZE);
+      if (sector + sector_cnt > disk_size (dst))
         PANIC ("%s: out of space on scratch disk", file_name);
       if (file_read (src, buffer, chunk_size) != chunk_size)
         PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
-      memset (buffer + chunk_size, 0, DISK_SECTOR_SIZE - chunk_size);
-      disk_write (dst, sector++, buffer);
+      memset (buffer + chunk_size, 0,
+              sector_cnt * DISK_SECTOR_SIZE - chunk_size);
+      disk_write_multiple (dst, sector, sector_cnt, buffer);
+      sector += sector_cnt;
       size -= chunk_size;
     }
 
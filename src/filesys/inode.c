@@ -1,23 +1,71 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
+#include <list.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of sector pointers in an on-disk inode that point
+   directly to data sectors. */
+#define DIRECT_CNT 122
+
+/* Number of sector pointers that fit in one index sector. */
+#define PTRS_PER_SECTOR (DISK_SECTOR_SIZE / sizeof (disk_sector_t))
+
+/* Maximum number of data sectors in a file: the direct sectors,
+   the sectors reached through the indirect sector, and the
+   sectors reached through the doubly indirect sector. */
+#define MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR \
+                     + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
+/* Maximum size of a file whose data is stored inline, in the
+   space that otherwise holds its sector pointers. */
+#define INLINE_MAX ((DIRECT_CNT + 2) * sizeof (disk_sector_t))
+
 /* On-disk inode.
-   Must be exactly DISK_SECTOR_SIZE bytes long. */
+   Must be exactly DISK_SECTOR_SIZE bytes long.
+
+   A file no longer than INLINE_MAX bytes is created with its data
+   inline, in the inode itself, so that reading the inode also
+   reads the data, and no data sector is needed.  Bytes past the
+   end of inline data are always zero.  When the file grows past
+   INLINE_MAX bytes, its data moves to a data sector.
+
+   Otherwise, a sector pointer of 0 means that no sector is
+   allocated.  Such a hole in a file reads as zeros.
+   Sector 0 holds the free map inode, so it is never a data or
+   index sector.
+
+   The inode itself and its index sectors are always journaled.
+   Its data sectors are journaled too if JOURNALED is nonzero,
+   because they hold metadata, as for directories and the free
+   map. */
 struct inode_disk
   {
-    disk_sector_t start;                /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t journaled;                 /* Journal data sectors? */
+    uint32_t inlined;                   /* Data stored inline? */
+    union
+      {
+        struct
+          {
+            disk_sector_t direct[DIRECT_CNT]; /* Direct data sectors. */
+            disk_sector_t indirect;     /* Indirect index sector. */
+            disk_sector_t doubly_indirect; /* Doubly indirect index. */
+          };
+        uint8_t inline_data[INLINE_MAX]; /* Data, if INLINED. */
+      };
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,49 +76,571 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
+/* Maximum number of delayed blocks that an inode holds before
+   it allocates disk space for them. */
+#define DELAYED_MAX 64
+
+/* Maximum number of sectors that inode_preallocate() allocates
+   as a single run. */
+#define PREALLOCATE_RUN_MAX 1024
+
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in `open_inodes'. */
     disk_sector_t sector;               /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
+    bool loaded;                        /* Has DATA been read from disk? */
+    bool closing;                       /* Being closed by last opener? */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct lock lock;                   /* Protects DATA and DELAYED. */
+    struct list delayed;                /* Delayed blocks, ordered by idx. */
+    size_t delayed_cnt;                 /* Number of delayed blocks. */
+    size_t delayed_reserved;            /* Sectors reserved for them. */
     struct inode_disk data;             /* Inode content. */
   };
 
-/* Returns the disk sector that contains byte offset POS within
-   INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+/* A block of file data written past the sectors allocated to
+   its file, for which no disk sector has been chosen yet.
+
+   Writes to a sector of a file that has no sector allocated, for
+   example because they extend the file, go into delayed blocks
+   instead of newly allocated sectors.  The blocks are given sectors when
+   the file is closed for the last time, when it has more than
+   DELAYED_MAX of them, or when the file system shuts down.  By
+   then the final size of a file, or a large piece of it, is
+   known, so its sectors can be allocated as a few contiguous
+   runs, even while other files grow at the same time.
+
+   An inode's delayed blocks hold reservations in the free map
+   for their data sectors and for the index sectors they need
+   that do not exist yet, each index sector reserved only once,
+   so that allocation cannot later fail for lack of space. */
+struct delayed_block
+  {
+    struct list_elem elem;              /* Element in inode's `delayed'. */
+    size_t idx;                         /* Data sector number in file. */
+    uint8_t data[DISK_SECTOR_SIZE];     /* Data. */
+  };
+
+/* Writes SIZE bytes from BUFFER into SECTOR starting at offset
+   OFS within the sector, through the buffer cache, as part of
+   the running transaction if JOURNAL is true. */
+static void
+write_sector (disk_sector_t sector, const void *buffer, size_t ofs,
+              size_t size, bool journal) 
+{
+  if (journal)
+    journal_add (sector);
+  cache_write (sector, buffer, ofs, size);
+}
+
+/* If *SECTORP is 0 and ALLOCATE is true, allocates a new
+   zero-filled sector, as close after GOAL as possible, and stores
+   its number into *SECTORP.  If RESERVED is non-null and
+   *RESERVED is nonzero, the sector is taken out of *RESERVED
+   sectors reserved with free_map_reserve(), and *RESERVED is
+   decremented.  The zeros are journaled if JOURNAL is true.
+   Returns true if *SECTORP is now nonzero, false otherwise. */
+static bool
+resolve_sector (disk_sector_t *sectorp, bool allocate, disk_sector_t goal,
+                bool journal, size_t *reserved) 
+{
+  static char zeros[DISK_SECTOR_SIZE];
+
+  if (*sectorp == 0 && allocate) 
+    {
+      bool allocated;
+
+      if (reserved != NULL && *reserved > 0) 
+        {
+          allocated = free_map_allocate_reserved (1, goal, sectorp);
+          if (allocated)
+            --*reserved;
+        }
+      else
+        allocated = free_map_allocate (1, goal, sectorp);
+      if (allocated)
+        write_sector (*sectorp, zeros, 0, DISK_SECTOR_SIZE, journal);
+    }
+  return *sectorp != 0;
+}
+
+/* Returns the sector stored in entry OFS of the index sector
+   *INDEXP, or 0 if none.  If ALLOCATE is true, allocates the
+   index sector and the entry as needed, near GOAL, updating
+   *INDEXP.  A newly allocated entry's zeros are journaled if
+   JOURNAL is true. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+index_lookup (disk_sector_t *indexp, size_t ofs, bool allocate,
+              disk_sector_t goal, bool journal) 
 {
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / DISK_SECTOR_SIZE;
-  else
-    return -1;
+  disk_sector_t sector;
+
+  ASSERT (ofs < PTRS_PER_SECTOR);
+
+  if (!resolve_sector (indexp, allocate, goal, true, NULL))
+    return 0;
+
+  cache_read (*indexp, &sector, ofs * sizeof sector, sizeof sector);
+  if (sector == 0
+      && resolve_sector (&sector, allocate, goal, journal, NULL))
+    write_sector (*indexp, &sector, ofs * sizeof sector, sizeof sector,
+                  true);
+  return sector;
+}
+
+/* Returns the sector that holds data sector number IDX within
+   DISK_INODE, or 0 if that sector is not allocated.  If ALLOCATE
+   is true, allocates a zero-filled data sector and any index
+   sectors needed to reach it, as close after GOAL as possible,
+   updating DISK_INODE but not writing it back to disk.  Returns
+   0 if allocation fails. */
+static disk_sector_t
+lookup_sector (struct inode_disk *disk_inode, size_t idx, bool allocate,
+               disk_sector_t goal) 
+{
+  bool journal = disk_inode->journaled != 0;
+  disk_sector_t sector;
+
+  if (idx < DIRECT_CNT)
+    {
+      resolve_sector (&disk_inode->direct[idx], allocate, goal, journal,
+                      NULL);
+      return disk_inode->direct[idx];
+    }
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    return index_lookup (&disk_inode->indirect, idx, allocate, goal,
+                         journal);
+  idx -= PTRS_PER_SECTOR;
+
+  if (idx < PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+    {
+      sector = index_lookup (&disk_inode->doubly_indirect,
+                             idx / PTRS_PER_SECTOR, allocate, goal, true);
+      if (sector == 0)
+        return 0;
+      return index_lookup (&sector, idx % PTRS_PER_SECTOR, allocate, goal,
+                           journal);
+    }
+
+  return 0;
+}
+
+/* Stores SECTOR into entry OFS of the index sector *INDEXP,
+   allocating the index sector near GOAL if needed, out of
+   *RESERVED as in resolve_sector().  Returns true if successful,
+   false if allocation fails. */
+static bool
+index_store (disk_sector_t *indexp, size_t ofs, disk_sector_t sector,
+             disk_sector_t goal, size_t *reserved) 
+{
+  ASSERT (ofs < PTRS_PER_SECTOR);
+
+  if (!resolve_sector (indexp, true, goal, true, reserved))
+    return false;
+  write_sector (*indexp, &sector, ofs * sizeof sector, sizeof sector, true);
+  return true;
+}
+
+/* Makes SECTOR, which the caller has already allocated, data
+   sector number IDX within DISK_INODE, allocating any index
+   sectors needed to reach it near GOAL, out of *RESERVED as in
+   resolve_sector().  Updates DISK_INODE but does not write it
+   back to disk.  Returns true if successful, false if allocation
+   fails. */
+static bool
+install_sector (struct inode_disk *disk_inode, size_t idx,
+                disk_sector_t sector, disk_sector_t goal, size_t *reserved) 
+{
+  disk_sector_t index;
+  size_t ofs;
+
+  if (idx < DIRECT_CNT)
+    {
+      disk_inode->direct[idx] = sector;
+      return true;
+    }
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    return index_store (&disk_inode->indirect, idx, sector, goal, reserved);
+  idx -= PTRS_PER_SECTOR;
+
+  ASSERT (idx < PTRS_PER_SECTOR * PTRS_PER_SECTOR);
+  if (!resolve_sector (&disk_inode->doubly_indirect, true, goal, true,
+                       reserved))
+    return false;
+  ofs = idx / PTRS_PER_SECTOR;
+  cache_read (disk_inode->doubly_indirect, &index,
+              ofs * sizeof index, sizeof index);
+  if (index == 0) 
+    {
+      if (!resolve_sector (&index, true, goal, true, reserved))
+        return false;
+      write_sector (disk_inode->doubly_indirect, &index,
+                    ofs * sizeof index, sizeof index, true);
+    }
+  return index_store (&index, idx % PTRS_PER_SECTOR, sector, goal, reserved);
+}
+
+/* Allocates a zero-filled sector for data sector number IDX of
+   DISK_INODE, which is stored in INODE_SECTOR, right after the
+   file's previous data sector if possible, or after the inode if
+   that sector is a hole, to keep files contiguous.  Does not
+   write DISK_INODE back to disk.  Returns the new sector, or 0 if
+   allocation fails. */
+static disk_sector_t
+allocate_sector (struct inode_disk *disk_inode, disk_sector_t inode_sector,
+                 size_t idx) 
+{
+  disk_sector_t goal = 0;
+
+  if (idx > 0)
+    goal = lookup_sector (disk_inode, idx - 1, false, 0);
+  return lookup_sector (disk_inode, idx, true,
+                        goal != 0 ? goal : inode_sector);
+}
+
+/* Releases SECTOR and, if LEVEL is greater than 0, all of the
+   sectors it refers to, treating it as an index sector with LEVEL
+   levels of indexing below it. */
+static void
+release_tree (disk_sector_t sector, int level) 
+{
+  if (sector == 0)
+    return;
+
+  if (level > 0)
+    {
+      disk_sector_t *index = malloc (DISK_SECTOR_SIZE);
+      size_t i;
+
+      if (index == NULL)
+        PANIC ("out of memory releasing inode sectors");
+      cache_read (sector, index, 0, DISK_SECTOR_SIZE);
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        release_tree (index[i], level - 1);
+      free (index);
+    }
+  free_map_release (sector, 1);
+  journal_restart ();
+}
+
+/* Releases all of the data and index sectors of DISK_INODE. */
+static void
+release_sectors (struct inode_disk *disk_inode) 
+{
+  size_t i;
+
+  if (disk_inode->inlined)
+    return;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_tree (disk_inode->direct[i], 0);
+  release_tree (disk_inode->indirect, 1);
+  release_tree (disk_inode->doubly_indirect, 2);
+}
+
+/* Returns INODE's delayed block for data sector number IDX, or a
+   null pointer if it has none.  The caller must hold INODE's
+   lock. */
+static struct delayed_block *
+find_delayed (struct inode *inode, size_t idx) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&inode->delayed); e != list_end (&inode->delayed);
+       e = list_next (e)) 
+    {
+      struct delayed_block *db = list_entry (e, struct delayed_block, elem);
+      if (db->idx >= idx)
+        return db->idx == idx ? db : NULL;
+    }
+  return NULL;
+}
+
+/* Returns true if INODE has a delayed block for a data sector
+   number in [START, END).  The caller must hold INODE's lock. */
+static bool
+delayed_in_range (struct inode *inode, size_t start, size_t end) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&inode->delayed); e != list_end (&inode->delayed);
+       e = list_next (e)) 
+    {
+      size_t idx = list_entry (e, struct delayed_block, elem)->idx;
+      if (idx >= start)
+        return idx < end;
+    }
+  return false;
+}
+
+/* Returns the number of index sectors that a new delayed block
+   for data sector number IDX in INODE needs, not counting those
+   that exist already or that are reserved for INODE's other
+   delayed blocks.  The caller must hold INODE's lock. */
+static size_t
+index_sectors_needed (struct inode *inode, size_t idx) 
+{
+  const struct inode_disk *disk_inode = &inode->data;
+  size_t first = DIRECT_CNT + PTRS_PER_SECTOR;
+  size_t start, cnt = 0;
+  disk_sector_t index = 0;
+
+  if (idx < DIRECT_CNT)
+    return 0;
+  else if (idx < first)
+    return (disk_inode->indirect == 0
+            && !delayed_in_range (inode, DIRECT_CNT, first));
+
+  if (disk_inode->doubly_indirect == 0
+      && !delayed_in_range (inode, first, MAX_SECTORS))
+    cnt++;
+  start = idx - (idx - first) % PTRS_PER_SECTOR;
+  if (!delayed_in_range (inode, start, start + PTRS_PER_SECTOR)) 
+    {
+      if (disk_inode->doubly_indirect != 0)
+        cache_read (disk_inode->doubly_indirect, &index,
+                    (idx - first) / PTRS_PER_SECTOR * sizeof index,
+                    sizeof index);
+      if (index == 0)
+        cnt++;
+    }
+  return cnt;
+}
+
+/* Copies SIZE bytes from BUFFER into INODE's delayed block for
+   data sector number IDX, starting at byte offset OFS within the
+   block, creating a zero-filled block if there is none yet.
+   Returns true if successful, false if memory or free disk space
+   runs out.  The caller must hold INODE's lock. */
+static bool
+write_delayed (struct inode *inode, size_t idx, int ofs,
+               const void *buffer, int size) 
+{
+  struct delayed_block *db = find_delayed (inode, idx);
+
+  if (db == NULL) 
+    {
+      struct list_elem *e;
+      size_t reserve;
+
+      if (idx >= MAX_SECTORS)
+        return false;
+      reserve = 1 + index_sectors_needed (inode, idx);
+      if (!free_map_reserve (reserve))
+        return false;
+      db = malloc (sizeof *db);
+      if (db == NULL) 
+        {
+          free_map_unreserve (reserve);
+          return false;
+        }
+      inode->delayed_reserved += reserve;
+      db->idx = idx;
+      memset (db->data, 0, DISK_SECTOR_SIZE);
+
+      for (e = list_begin (&inode->delayed); e != list_end (&inode->delayed);
+           e = list_next (e))
+        if (list_entry (e, struct delayed_block, elem)->idx > idx)
+          break;
+      list_insert (e, &db->elem);
+      inode->delayed_cnt++;
+    }
+
+  memcpy (db->data + ofs, buffer, size);
+  return true;
+}
+
+/* Allocates disk sectors for all of INODE's delayed blocks,
+   writes the blocks into the buffer cache, and writes INODE back
+   to disk.  Each run of consecutive blocks goes into a single
+   run of sectors right after the sector before it in the file,
+   if one is free, or into as few runs as possible otherwise.
+   The caller must hold INODE's lock and be inside a transaction.
+   On a crash, sectors allocated for the blocks before INODE is
+   written back are leaked. */
+static void
+flush_delayed (struct inode *inode) 
+{
+  struct inode_disk *disk_inode = &inode->data;
+
+  if (list_empty (&inode->delayed))
+    return;
+
+  while (!list_empty (&inode->delayed)) 
+    {
+      struct list_elem *e = list_front (&inode->delayed);
+      size_t first = list_entry (e, struct delayed_block, elem)->idx;
+      disk_sector_t goal = inode->sector;
+      disk_sector_t start;
+      size_t run, i;
+
+      /* Find the run of consecutive blocks at the front. */
+      for (run = 1; (e = list_next (e)) != list_end (&inode->delayed);
+           run++)
+        if (list_entry (e, struct delayed_block, elem)->idx != first + run)
+          break;
+
+      /* Allocate the run, halving it until it fits if the free
+         space is fragmented.  A single sector always fits
+         because it is reserved. */
+      if (first > 0 && lookup_sector (disk_inode, first - 1, false, 0) != 0)
+        goal = lookup_sector (disk_inode, first - 1, false, 0);
+      while (!free_map_allocate_reserved (run, goal, &start))
+        {
+          ASSERT (run > 1);
+          run /= 2;
+        }
+      inode->delayed_reserved -= run;
+
+      /* Index sectors come out of the rest of the reservation. */
+      for (i = 0; i < run; i++) 
+        {
+          struct delayed_block *db
+            = list_entry (list_pop_front (&inode->delayed),
+                          struct delayed_block, elem);
+
+          if (install_sector (disk_inode, db->idx, start + i, start + run,
+                              &inode->delayed_reserved))
+            write_sector (start + i, db->data, 0, DISK_SECTOR_SIZE, false);
+          else 
+            {
+              printf ("inode %"PRDSNu": lost data sector %zu\n",
+                      inode->sector, db->idx);
+              free_map_release (start + i, 1);
+            }
+          free (db);
+          inode->delayed_cnt--;
+        }
+      journal_restart ();
+    }
+  write_sector (inode->sector, disk_inode, 0, DISK_SECTOR_SIZE, true);
+
+  /* Give back reservations for index sectors that turned out to
+     exist already. */
+  free_map_unreserve (inode->delayed_reserved);
+  inode->delayed_reserved = 0;
+}
+
+/* Frees all of INODE's delayed blocks without writing them,
+   giving back their reservations. */
+static void
+discard_delayed (struct inode *inode) 
+{
+  while (!list_empty (&inode->delayed)) 
+    {
+      struct delayed_block *db
+        = list_entry (list_pop_front (&inode->delayed),
+                      struct delayed_block, elem);
+      free (db);
+    }
+  inode->delayed_cnt = 0;
+  free_map_unreserve (inode->delayed_reserved);
+  inode->delayed_reserved = 0;
+}
+
+/* Moves INODE's inline data out of the inode, so that the file
+   can grow past INLINE_MAX bytes: into a zero-filled data sector
+   if INODE's data is journaled, otherwise into a delayed block.
+   Returns true if successful, false if memory or disk space runs
+   out, in which case the data stays inline.  The caller must
+   hold INODE's lock and be inside a transaction. */
+static bool
+promote (struct inode *inode) 
+{
+  struct inode_disk *disk_inode = &inode->data;
+  off_t length = disk_inode->length;
+  uint8_t *data;
+  bool success;
+
+  data = malloc (INLINE_MAX);
+  if (data == NULL)
+    return false;
+  memcpy (data, disk_inode->inline_data, INLINE_MAX);
+  memset (disk_inode->inline_data, 0, INLINE_MAX);
+  disk_inode->inlined = false;
+
+  if (length == 0)
+    success = true;
+  else if (!disk_inode->journaled)
+    success = write_delayed (inode, 0, 0, data, length);
+  else 
+    {
+      disk_sector_t sector = allocate_sector (disk_inode, inode->sector, 0);
+      success = sector != 0;
+      if (success)
+        write_sector (sector, data, 0, length, true);
+    }
+
+  if (!success) 
+    {
+      memcpy (disk_inode->inline_data, data, INLINE_MAX);
+      disk_inode->inlined = true;
+    }
+  free (data);
+  return success;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Table of open inodes, keyed by sector, so that opening a
+   single inode twice returns the same `struct inode'. */
+static struct hash open_inodes;
+
+/* Protects `open_inodes' and the open_cnt, loaded, closing, and
+   deny_write_cnt members of every open inode. */
+static struct lock open_inodes_lock;
+
+/* Broadcast when an inode finishes loading from disk, and when
+   one finishes closing and leaves `open_inodes'. */
+static struct condition inode_loaded;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+static struct inode *find_open_inode (disk_sector_t);
+static struct inode *reopen_locked (struct inode *);
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("can't initialize open inode table");
+  lock_init (&open_inodes_lock);
+  cond_init (&inode_loaded);
+}
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Returns true if inode A's sector precedes inode B's. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED) 
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   disk.
+   disk.  If JOURNALED is true, the inode's data is metadata, and
+   writes to it are journaled.  The file starts out sparse: its
+   data reads as zeros, and sectors are only allocated for it when
+   they are first written.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails or LENGTH is too
+   big. */
 bool
-inode_create (disk_sector_t sector, off_t length)
+inode_create (disk_sector_t sector, off_t length, bool journaled)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -81,26 +651,21 @@ inode_create (disk_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
 
+  if (bytes_to_sectors (length) > MAX_SECTORS)
+    return false;
+
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start))
-        {
-          disk_write (filesys_disk, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[DISK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                disk_write (filesys_disk, disk_inode->start + i, zeros); 
-            }
-          success = true; 
-        } 
+      disk_inode->journaled = journaled;
+      disk_inode->inlined = length <= (off_t) INLINE_MAX;
+      journal_begin ();
+      write_sector (sector, disk_inode, 0, DISK_SECTOR_SIZE, true);
+      journal_end ();
       free (disk_inode);
+      success = true; 
     }
   return success;
 }
@@ -111,33 +676,100 @@ inode_create (disk_sector_t sector, off_t length)
 struct inode *
 inode_open (disk_sector_t sector) 
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct inode *inode, *new;
+  struct hash_elem *e;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
-    }
+  lock_acquire (&open_inodes_lock);
+  inode = find_open_inode (sector);
+  if (inode != NULL)
+    return reopen_locked (inode);
+  lock_release (&open_inodes_lock);
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
-  if (inode == NULL)
+  new = malloc (sizeof *new);
+  if (new == NULL)
     return NULL;
+  new->sector = sector;
+
+  /* Another thread may have opened the inode while we were
+     allocating memory. */
+  lock_acquire (&open_inodes_lock);
+  inode = find_open_inode (sector);
+  if (inode != NULL) 
+    {
+      free (new);
+      return reopen_locked (inode);
+    }
+  inode = new;
+  e = hash_insert (&open_inodes, &inode->elem);
+  ASSERT (e == NULL);
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
-  inode->sector = sector;
   inode->open_cnt = 1;
+  inode->loaded = false;
+  inode->closing = false;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  disk_read (filesys_disk, inode->sector, &inode->data);
+  lock_init (&inode->lock);
+  list_init (&inode->delayed);
+  inode->delayed_cnt = 0;
+  inode->delayed_reserved = 0;
+  lock_release (&open_inodes_lock);
+
+  /* Read the inode without holding the lock.  Other threads that
+     open it in the meantime wait in reopen_locked() instead of
+     reading it a second time. */
+  cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+
+  lock_acquire (&open_inodes_lock);
+  inode->loaded = true;
+  cond_broadcast (&inode_loaded, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
+  return inode;
+}
+
+/* Returns the open inode for SECTOR, or a null pointer if it is
+   not open.  If the inode is being closed by its last opener,
+   first waits for the close to finish, so that the inode is read
+   from disk again only once all of its changes are there.  The
+   caller must hold open_inodes_lock, which may be released and
+   reacquired. */
+static struct inode *
+find_open_inode (disk_sector_t sector) 
+{
+  /* Static to keep a whole struct inode off the kernel stack.
+     Protected by open_inodes_lock. */
+  static struct inode key;
+
+  ASSERT (lock_held_by_current_thread (&open_inodes_lock));
+
+  for (;;) 
+    {
+      struct hash_elem *e;
+      struct inode *inode;
+
+      key.sector = sector;
+      e = hash_find (&open_inodes, &key.elem);
+      if (e == NULL)
+        return NULL;
+      inode = hash_entry (e, struct inode, elem);
+      if (!inode->closing)
+        return inode;
+      cond_wait (&inode_loaded, &open_inodes_lock);
+    }
+}
+
+/* Adds an opener to INODE, waits until INODE has been read from
+   disk, releases open_inodes_lock, which the caller must hold,
+   and returns INODE. */
+static struct inode *
+reopen_locked (struct inode *inode) 
+{
+  inode->open_cnt++;
+  while (!inode->loaded)
+    cond_wait (&inode_loaded, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -145,8 +777,12 @@ inode_open (disk_sector_t sector)
 struct inode *
 inode_reopen (struct inode *inode)
 {
-  if (inode != NULL)
-    inode->open_cnt++;
+  if (inode != NULL) 
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -163,23 +799,45 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  /* Mark the inode as closing if this was the last opener.  It
+     stays in the inode table until it is completely written
+     back, so that anyone who opens it meanwhile waits instead of
+     reading a stale copy from disk. */
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    inode->closing = true;
+  lock_release (&open_inodes_lock);
+
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks if removed, otherwise give the delayed
+         blocks their sectors. */
+      journal_begin ();
+      lock_acquire (&inode->lock);
       if (inode->removed) 
         {
+          discard_delayed (inode);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_sectors (&inode->data);
         }
+      else
+        flush_delayed (inode);
+      lock_release (&inode->lock);
+      journal_end ();
+
+      /* Remove from inode table. */
+      lock_acquire (&open_inodes_lock);
+      hash_delete (&open_inodes, &inode->elem);
+      cond_broadcast (&inode_loaded, &open_inodes_lock);
+      lock_release (&open_inodes_lock);
 
       free (inode); 
     }
@@ -194,20 +852,31 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
-   Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+/* How read_at() uses the buffer cache. */
+enum read_mode 
+  {
+    READ_CACHED,                /* Read through the cache. */
+    READ_UNCACHED,              /* Don't cache whole sectors. */
+    READ_IF_CACHED              /* Stop rather than wait. */
+  };
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+   OFFSET, using the cache as MODE directs.  With READ_IF_CACHED,
+   stops at the first data sector that is not in the cache, or if
+   INODE is locked by another thread.
+   Returns the number of bytes actually read. */
+static off_t
+read_at (struct inode *inode, void *buffer_, off_t size, off_t offset,
+         enum read_mode mode) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      size_t idx = offset / DISK_SECTOR_SIZE;
+      disk_sector_t sector_idx;
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -220,99 +889,173 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
+      /* Inline data is in the inode, and data that has no sector
+         yet is in a delayed block. */
+      if (mode != READ_IF_CACHED)
+        lock_acquire (&inode->lock);
+      else if (!lock_try_acquire (&inode->lock))
+        break;
+      if (inode->data.inlined) 
+        {
+          memcpy (buffer + bytes_read, inode->data.inline_data + offset,
+                  chunk_size);
+          sector_idx = 0;
+        }
+      else if ((sector_idx = lookup_sector (&inode->data, idx, false, 0))
+               == 0) 
         {
-          /* Read full sector directly into caller's buffer. */
-          disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
+          struct delayed_block *db = find_delayed (inode, idx);
+          if (db != NULL)
+            memcpy (buffer + bytes_read, db->data + sector_ofs, chunk_size);
+          else
+            memset (buffer + bytes_read, 0, chunk_size);
         }
-      else 
+      lock_release (&inode->lock);
+
+      if (sector_idx != 0) 
         {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
+          if (mode == READ_IF_CACHED) 
             {
-              bounce = malloc (DISK_SECTOR_SIZE);
-              if (bounce == NULL)
+              if (!cache_try_read (sector_idx, buffer + bytes_read,
+                                   sector_ofs, chunk_size))
                 break;
             }
-          disk_read (filesys_disk, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          else if (mode == READ_UNCACHED && chunk_size == DISK_SECTOR_SIZE)
+            cache_read_uncached (sector_idx, buffer + bytes_read);
+          else
+            cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+                        chunk_size);
         }
-      
+
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  return read_at (inode, buffer, size, offset, READ_CACHED);
+}
+
+/* Like inode_read_at(), but for data that the caller keeps in
+   its own memory, such as pages of a user process: sectors that
+   are not in the buffer cache are read directly from disk and
+   not added to it. */
+off_t
+inode_read_uncached (struct inode *inode, void *buffer, off_t size,
+                     off_t offset) 
+{
+  return read_at (inode, buffer, size, offset, READ_UNCACHED);
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+   OFFSET, if that can be done without reading data from disk or
+   waiting for another thread.  Index sectors may still be read,
+   but those needed to reach data that is cached usually are
+   cached too.  Returns true if all SIZE bytes were read, false
+   otherwise. */
+bool
+inode_try_read (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  return read_at (inode, buffer, size, offset, READ_IF_CACHED) == size;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Extends INODE if the write goes past end of file.  Data past
+   the sectors already allocated goes into delayed blocks, unless
+   INODE's data is journaled.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or an error occurs. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  bool inode_dirty = false;
 
   if (inode->deny_write_cnt)
     return 0;
 
+  journal_begin ();
+  lock_acquire (&inode->lock);
+
+  /* Write inline data in place, unless it would grow too big. */
+  if (inode->data.inlined && size > 0) 
+    {
+      if (offset + size <= (off_t) INLINE_MAX) 
+        {
+          memcpy (inode->data.inline_data + offset, buffer, size);
+          if (offset + size > inode->data.length)
+            inode->data.length = offset + size;
+          write_sector (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE,
+                        true);
+          lock_release (&inode->lock);
+          journal_end ();
+          return size;
+        }
+      else if (!promote (inode)) 
+        {
+          lock_release (&inode->lock);
+          journal_end ();
+          return 0;
+        }
+      inode_dirty = true;
+    }
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      size_t idx = offset / DISK_SECTOR_SIZE;
+      disk_sector_t sector_idx = lookup_sector (&inode->data, idx, false, 0);
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = DISK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
-
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
+      int sector_left = DISK_SECTOR_SIZE - sector_ofs;
+      int chunk_size = size < sector_left ? size : sector_left;
 
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
+      /* The first write to a sector of a journaled inode allocates
+         it right away, because delayed blocks are not journaled. */
+      if (sector_idx == 0 && inode->data.journaled) 
         {
-          /* Write full sector directly to disk. */
-          disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
+          sector_idx = allocate_sector (&inode->data, inode->sector, idx);
+          if (sector_idx == 0)
+            break;
+          inode_dirty = true;
         }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (DISK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            disk_read (filesys_disk, sector_idx, bounce);
-          else
-            memset (bounce, 0, DISK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          disk_write (filesys_disk, sector_idx, bounce); 
-        }
+      if (sector_idx != 0)
+        write_sector (sector_idx, buffer + bytes_written, sector_ofs,
+                      chunk_size, inode->data.journaled);
+      else if (!write_delayed (inode, idx, sector_ofs,
+                               buffer + bytes_written, chunk_size))
+        break;
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  if (bytes_written > 0 && offset > inode->data.length) 
+    {
+      inode->data.length = offset;
+      inode_dirty = true;
+    }
+  if (inode->delayed_cnt > DELAYED_MAX)
+    flush_delayed (inode);
+  else if (inode_dirty)
+    write_sector (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE, true);
+  lock_release (&inode->lock);
+  journal_end ();
 
   return bytes_written;
 }
@@ -322,8 +1065,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&open_inodes_lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&open_inodes_lock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +1077,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&open_inodes_lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&open_inodes_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -343,3 +1090,157 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Gives disk sectors to the delayed blocks of every open inode.
+   Called when the file system shuts down. */
+void
+inode_flush_delayed (void) 
+{
+  struct hash_iterator i;
+  struct inode **inodes;
+  size_t cnt, j;
+
+  /* Take a reference to each inode, so that none of them can be
+     freed once `open_inodes_lock' is released.  flush_delayed()
+     may have to wait for a journal commit, which must not happen
+     while holding that lock. */
+  lock_acquire (&open_inodes_lock);
+  inodes = malloc (hash_size (&open_inodes) * sizeof *inodes);
+  if (inodes == NULL && hash_size (&open_inodes) > 0)
+    PANIC ("out of memory flushing delayed blocks");
+  cnt = 0;
+  hash_first (&i, &open_inodes);
+  while (hash_next (&i)) 
+    {
+      struct inode *inode = hash_entry (hash_cur (&i), struct inode, elem);
+      if (inode->loaded && !inode->removed && !inode->closing) 
+        {
+          inode->open_cnt++;
+          inodes[cnt++] = inode;
+        }
+    }
+  lock_release (&open_inodes_lock);
+
+  journal_begin ();
+  for (j = 0; j < cnt; j++) 
+    {
+      lock_acquire (&inodes[j]->lock);
+      flush_delayed (inodes[j]);
+      lock_release (&inodes[j]->lock);
+    }
+  journal_end ();
+
+  for (j = 0; j < cnt; j++)
+    inode_close (inodes[j]);
+  free (inodes);
+}
+
+/* Returns true if data sector number IDX of INODE has a sector or
+   a delayed block.  The caller must hold INODE's lock. */
+static bool
+has_data (struct inode *inode, size_t idx) 
+{
+  return (lookup_sector (&inode->data, idx, false, 0) != 0
+          || find_delayed (inode, idx) != NULL);
+}
+
+/* Allocates disk sectors for all of the first LENGTH bytes of
+   INODE that have no data yet, in runs as long as the free space
+   allows, each right after the sector before it in the file if
+   possible, so that a file about to be written in full ends up in
+   a few contiguous extents.  Unlike the sectors that writes
+   allocate, these are not zero-filled: the caller must write all
+   LENGTH bytes before anyone reads them.  Returns true if
+   successful, false if the disk fills up. */
+bool
+inode_preallocate (struct inode *inode, off_t length) 
+{
+  struct inode_disk *disk_inode = &inode->data;
+  size_t sectors = bytes_to_sectors (length);
+  bool success = true;
+  size_t idx = 0;
+
+  if (sectors > MAX_SECTORS)
+    return false;
+
+  journal_begin ();
+  lock_acquire (&inode->lock);
+  if (!disk_inode->inlined) 
+    {
+      while (success && idx < sectors) 
+        {
+          disk_sector_t goal = inode->sector;
+          disk_sector_t start;
+          bool allocated;
+          size_t run, i;
+
+          if (has_data (inode, idx)) 
+            {
+              idx++;
+              continue;
+            }
+
+          /* Find the run of sectors without data, and allocate
+             it, halving it until it fits if the free space is
+             fragmented. */
+          for (run = 1; idx + run < sectors && run < PREALLOCATE_RUN_MAX;
+               run++)
+            if (has_data (inode, idx + run))
+              break;
+          if (idx > 0 && lookup_sector (disk_inode, idx - 1, false, 0) != 0)
+            goal = lookup_sector (disk_inode, idx - 1, false, 0);
+          while (!(allocated = free_map_allocate (run, goal, &start))
+                 && run > 1)
+            run /= 2;
+          if (!allocated) 
+            {
+              success = false;
+              break;
+            }
+
+          for (i = 0; i < run; i++) 
+            {
+              if (!install_sector (disk_inode, idx + i, start + i,
+                                   start + run, NULL)) 
+                {
+                  free_map_release (start + i, run - i);
+                  success = false;
+                  break;
+                }
+              journal_restart ();
+            }
+          idx += run;
+        }
+      write_sector (inode->sector, disk_inode, 0, DISK_SECTOR_SIZE, true);
+    }
+  lock_release (&inode->lock);
+  journal_end ();
+
+  return success;
+}
+
+/* Returns the number of extents in INODE, that is, the number of
+   runs of consecutive disk sectors that hold its data.  Delayed
+   blocks count as one extent each, and inline data as none. */
+size_t
+inode_extent_cnt (struct inode *inode) 
+{
+  size_t sectors = bytes_to_sectors (inode->data.length);
+  disk_sector_t prev = 0;
+  size_t extent_cnt = 0;
+  size_t idx;
+
+  lock_acquire (&inode->lock);
+  if (inode->data.inlined)
+    sectors = 0;
+  for (idx = 0; idx < sectors; idx++) 
+    {
+      disk_sector_t sector = lookup_sector (&inode->data, idx, false, 0);
+      if (sector == 0 ? find_delayed (inode, idx) != NULL : sector != prev + 1)
+        extent_cnt++;
+      prev = sector;
+    }
+  lock_release (&inode->lock);
+
+  return extent_cnt;
+}
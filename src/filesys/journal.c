@@ -0,0 +1,384 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-ahead journal for file system metadata.
+
+   Every change to metadata, that is, to inodes, index sectors,
+   directories, and the free map, is made inside a transaction,
+   between journal_begin() and journal_end().  Each metadata
+   sector is passed to journal_add() before it is modified, which
+   pins it in the buffer cache so that it cannot reach its home
+   location on disk ahead of the transaction.  Operations that
+   run at the same time join the same transaction.  When the last
+   of them ends, the transaction commits: the modified sectors
+   are appended to the journal region in one sequential run,
+   followed by a write of the journal header that lists their
+   home locations.  Writing the header is the commit point.
+
+   Once committed, the sectors are unpinned and reach their home
+   locations whenever the buffer cache evicts them.  Only when
+   the journal region is nearly full does a checkpoint flush the
+   cache and empty the journal.  After a crash, journal_replay()
+   copies each sector in the journal to its home location, so
+   recovery takes time proportional to the size of the journal,
+   not of the disk.
+
+   A sector that is freed must not be overwritten by a stale copy
+   from the journal after it is reused, so freeing a sector
+   revokes its entries in the journal. */
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Number of sectors that the journal region can hold. */
+#define JOURNAL_SLOTS (JOURNAL_SECTOR_CNT - 1)
+
+/* Maximum number of sectors in one transaction.  These are all
+   pinned in the buffer cache until the transaction commits, so
+   this must be well below the size of the cache. */
+#define TXN_MAX 48
+
+/* Number of sectors that an operation is assumed to modify when
+   it joins a transaction.  Long operations call
+   journal_restart() to stay within it. */
+#define OP_RESERVE 12
+
+/* Home location of a revoked journal entry. */
+#define REVOKED ((disk_sector_t) -1)
+
+/* On-disk journal header, in sector JOURNAL_SECTOR.
+   Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t cnt;                       /* Number of sectors logged. */
+    disk_sector_t sectors[JOURNAL_SLOTS]; /* Home locations. */
+  };
+
+static struct journal_header header;    /* Header, plus revocations. */
+static disk_sector_t txn_sectors[TXN_MAX]; /* Sectors in transaction. */
+static size_t txn_cnt;                  /* Number of sectors in txn. */
+static int outstanding;                 /* Operations in transaction. */
+static int dirty_ops;                   /* Outstanding operations that
+                                           have modified metadata. */
+static bool committing;                 /* Commit or checkpoint running? */
+static bool header_dirty;               /* Revocations not yet written? */
+static struct lock journal_lock;        /* Protects all of the above. */
+static struct condition journal_changed; /* Signaled when an operation
+                                           ends or a commit finishes. */
+
+/* Staging area for a transaction's sectors on their way to or
+   from the journal region.  Used only by the committing thread
+   or during replay. */
+static uint8_t log_buffer[TXN_MAX * DISK_SECTOR_SIZE];
+
+static void commit (void);
+static void checkpoint (void);
+static void write_header (void);
+
+/* Initializes the journal. */
+void
+journal_init (void) 
+{
+  ASSERT (sizeof header == DISK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  cond_init (&journal_changed);
+}
+
+/* Writes an empty journal to a newly formatted disk. */
+void
+journal_format (void) 
+{
+  header.magic = JOURNAL_MAGIC;
+  header.cnt = 0;
+  write_header ();
+}
+
+/* Copies every sector in the journal to its home location, then
+   empties the journal.  Must be called before the file system is
+   used. */
+void
+journal_replay (void) 
+{
+  size_t i;
+
+  disk_read (filesys_disk, JOURNAL_SECTOR, &header);
+  if (header.magic != JOURNAL_MAGIC || header.cnt > JOURNAL_SLOTS)
+    PANIC ("file system journal is corrupt");
+  if (header.cnt == 0)
+    return;
+
+  printf ("Replaying %"PRIu32" journaled sectors...", header.cnt);
+  for (i = 0; i < header.cnt; i += TXN_MAX) 
+    {
+      size_t cnt = header.cnt - i < TXN_MAX ? header.cnt - i : TXN_MAX;
+      size_t j;
+
+      disk_read_multiple (filesys_disk, JOURNAL_SECTOR + 1 + i, cnt,
+                          log_buffer);
+      for (j = 0; j < cnt; j++)
+        if (header.sectors[i + j] != REVOKED)
+          disk_write (filesys_disk, header.sectors[i + j],
+                      log_buffer + j * DISK_SECTOR_SIZE);
+    }
+  header.cnt = 0;
+  write_header ();
+  printf ("done.\n");
+}
+
+/* Writes every modified sector to its home location and empties
+   the journal.  Waits for running operations to finish. */
+void
+journal_checkpoint (void) 
+{
+  lock_acquire (&journal_lock);
+  while (committing || outstanding > 0)
+    cond_wait (&journal_changed, &journal_lock);
+  committing = true;
+  lock_release (&journal_lock);
+
+  checkpoint ();
+
+  lock_acquire (&journal_lock);
+  committing = false;
+  cond_broadcast (&journal_changed, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Starts an operation that modifies metadata, joining the
+   running transaction, if there is room for it in the
+   transaction, or waiting for that transaction to commit.
+   Operations may nest; only the outermost one counts. */
+void
+journal_begin (void) 
+{
+  struct thread *t = thread_current ();
+
+  if (t->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (committing || txn_cnt + (outstanding + 1) * OP_RESERVE > TXN_MAX)
+    cond_wait (&journal_changed, &journal_lock);
+  outstanding++;
+  t->journal_cnt = 0;
+  t->journal_dirty = false;
+  lock_release (&journal_lock);
+}
+
+/* Ends an operation started with journal_begin().  Commits the
+   transaction if this was its last running operation. */
+void
+journal_end (void) 
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  if (t->journal_dirty)
+    dirty_ops--;
+  outstanding--;
+
+  /* journal_restart() may be committing while other operations
+     are still running. */
+  while (outstanding == 0 && committing)
+    cond_wait (&journal_changed, &journal_lock);
+  if (outstanding == 0) 
+    {
+      committing = true;
+      lock_release (&journal_lock);
+
+      commit ();
+
+      lock_acquire (&journal_lock);
+      committing = false;
+    }
+  cond_broadcast (&journal_changed, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Called periodically by operations that modify an unbounded
+   number of sectors, at points where the metadata on disk would
+   be consistent apart from leaked sectors.  If the running
+   operation has modified about half the sectors it reserved,
+   ends it, committing the transaction if no other operation is
+   running, and joins the next transaction.
+
+   Unlike journal_begin(), does not wait for the other operations
+   to end, because the caller may hold locks that they need in
+   order to end.  If the transaction has no room for a fresh
+   reservation, waits only for the operations that have already
+   modified metadata, which hold the locks they need, and then
+   commits the transaction without the operations that have not,
+   since none of their changes are in it. */
+void
+journal_restart (void) 
+{
+  struct thread *t = thread_current ();
+  int depth = t->journal_depth;
+
+  ASSERT (depth > 0);
+  if (t->journal_cnt < OP_RESERVE / 2)
+    return;
+
+  t->journal_depth = 1;
+  journal_end ();
+
+  lock_acquire (&journal_lock);
+  for (;;) 
+    {
+      if (committing || (txn_cnt + (outstanding + 1) * OP_RESERVE > TXN_MAX
+                         && dirty_ops > 0))
+        cond_wait (&journal_changed, &journal_lock);
+      else if (txn_cnt + (outstanding + 1) * OP_RESERVE > TXN_MAX) 
+        {
+          committing = true;
+          lock_release (&journal_lock);
+
+          commit ();
+
+          lock_acquire (&journal_lock);
+          committing = false;
+          cond_broadcast (&journal_changed, &journal_lock);
+        }
+      else
+        break;
+    }
+  outstanding++;
+  t->journal_cnt = 0;
+  t->journal_dirty = false;
+  lock_release (&journal_lock);
+  t->journal_depth = depth;
+}
+
+/* Adds SECTOR to the running transaction.  Must be called before
+   SECTOR is modified in the buffer cache.  Waits for any commit
+   in progress, which journal_restart() may start while this
+   operation is running, so that the sector goes into the next
+   transaction. */
+void
+journal_add (disk_sector_t sector) 
+{
+  struct thread *t = thread_current ();
+  size_t i;
+
+  ASSERT (t->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&journal_changed, &journal_lock);
+  if (!t->journal_dirty) 
+    {
+      t->journal_dirty = true;
+      dirty_ops++;
+    }
+  for (i = 0; i < txn_cnt; i++)
+    if (txn_sectors[i] == sector)
+      goto done;
+  if (txn_cnt >= TXN_MAX)
+    PANIC ("file system transaction too large");
+  txn_sectors[txn_cnt++] = sector;
+  t->journal_cnt++;
+  cache_pin (sector);
+
+ done:
+  lock_release (&journal_lock);
+}
+
+/* Revokes the journal entries for SECTOR, which is being freed,
+   so that replaying the journal will not overwrite the sector
+   after it has been reused.  The revocation becomes permanent
+   when the running transaction commits.  Like journal_add(),
+   waits for any commit in progress, which owns the header and
+   the transaction's sectors. */
+void
+journal_revoke (disk_sector_t sector) 
+{
+  size_t i;
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&journal_changed, &journal_lock);
+  for (i = 0; i < header.cnt; i++)
+    if (header.sectors[i] == sector) 
+      {
+        header.sectors[i] = REVOKED;
+        header_dirty = true;
+      }
+  for (i = 0; i < txn_cnt; i++)
+    if (txn_sectors[i] == sector) 
+      {
+        txn_sectors[i] = txn_sectors[--txn_cnt];
+        cache_unpin (sector);
+        break;
+      }
+  lock_release (&journal_lock);
+}
+
+/* Commits the running transaction, whose operations have all
+   ended or have yet to modify metadata.  The caller must have set
+   COMMITTING, which keeps journal_add() and journal_revoke() from
+   touching the transaction or the header meanwhile. */
+static void
+commit (void) 
+{
+  size_t i;
+
+  if (txn_cnt == 0) 
+    {
+      if (header_dirty)
+        write_header ();
+      return;
+    }
+
+  /* Append the sectors to the journal, then commit by writing
+     the header. */
+  ASSERT (header.cnt + txn_cnt <= JOURNAL_SLOTS);
+  for (i = 0; i < txn_cnt; i++) 
+    {
+      cache_read (txn_sectors[i], log_buffer + i * DISK_SECTOR_SIZE,
+                  0, DISK_SECTOR_SIZE);
+      header.sectors[header.cnt + i] = txn_sectors[i];
+    }
+  disk_write_multiple (filesys_disk, JOURNAL_SECTOR + 1 + header.cnt,
+                       txn_cnt, log_buffer);
+  header.cnt += txn_cnt;
+  write_header ();
+
+  /* Let the sectors go home lazily. */
+  for (i = 0; i < txn_cnt; i++)
+    cache_unpin (txn_sectors[i]);
+  txn_cnt = 0;
+
+  /* Make sure the next transaction fits. */
+  if (header.cnt + TXN_MAX > JOURNAL_SLOTS)
+    checkpoint ();
+}
+
+/* Writes all modified sectors home and empties the journal.  No
+   transaction may be running. */
+static void
+checkpoint (void) 
+{
+  cache_flush ();
+  header.cnt = 0;
+  write_header ();
+}
+
+/* Writes the journal header to disk. */
+static void
+write_header (void) 
+{
+  disk_write (filesys_disk, JOURNAL_SECTOR, &header);
+  header_dirty = false;
+}
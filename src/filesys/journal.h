@@ -0,0 +1,22 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include "devices/disk.h"
+
+/* Number of sectors in the journal region, which starts at
+   JOURNAL_SECTOR: a header sector followed by the logged
+   sectors. */
+#define JOURNAL_SECTOR_CNT 127
+
+void journal_init (void);
+void journal_format (void);
+void journal_replay (void);
+void journal_checkpoint (void);
+
+void journal_begin (void);
+void journal_end (void);
+void journal_restart (void);
+void journal_add (disk_sector_t);
+void journal_revoke (disk_sector_t);
+
+#endif /* filesys/journal.h */
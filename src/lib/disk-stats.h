@@ -0,0 +1,28 @@
+#ifndef __LIB_DISK_STATS_H
+#define __LIB_DISK_STATS_H
+
+/* Number of buckets in a histogram of disk command service times.
+   Bucket 0 counts commands that took less than 2 us, and bucket
+   I, for I > 0, those that took from 2**I to 2**(I+1) - 1 us.
+   The last bucket also counts any that took longer. */
+#define DISK_LATENCY_BUCKETS 24
+
+/* Statistics for one disk, as returned by the diskstats system
+   call. */
+struct disk_stats
+  {
+    long long read_cnt;         /* Number of sectors read. */
+    long long write_cnt;        /* Number of sectors written. */
+    long long dma_cnt;          /* Number of sectors moved by DMA. */
+    long long cmd_cnt;          /* Number of commands issued. */
+    long long seq_cnt;          /* Number of commands that began at
+                                   the sector after the previous
+                                   command's last sector. */
+    long long queue_usecs;      /* Queue depth integrated over time,
+                                   in request-microseconds. */
+    long long elapsed_usecs;    /* Time over which QUEUE_USECS was
+                                   integrated, in microseconds. */
+    long long latency[DISK_LATENCY_BUCKETS]; /* Service times. */
+  };
+
+#endif /* lib/disk-stats.h */
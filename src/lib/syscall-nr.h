@@ -28,7 +28,14 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Copy-on-write process duplication. */
+    SYS_FORK,                   /* Duplicate this process. */
+
+    /* Statistics. */
+    SYS_DISKSTATS,              /* Obtain a disk's I/O statistics. */
+    SYS_VMSTATS                 /* Obtain virtual memory statistics. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -182,3 +182,21 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+pid_t
+fork (void) 
+{
+  return syscall0 (SYS_FORK);
+}
+
+bool
+diskstats (int chan_no, int dev_no, struct disk_stats *stats) 
+{
+  return syscall3 (SYS_DISKSTATS, chan_no, dev_no, stats);
+}
+
+bool
+vmstats (struct vm_stats *stats) 
+{
+  return syscall1 (SYS_VMSTATS, stats);
+}
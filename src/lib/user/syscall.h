@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <disk-stats.h>
+#include <vm-stats.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +47,11 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Copy-on-write process duplication. */
+pid_t fork (void);
+
+/* Statistics. */
+bool diskstats (int chan_no, int dev_no, struct disk_stats *);
+bool vmstats (struct vm_stats *);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,21 @@
+#ifndef __LIB_VM_STATS_H
+#define __LIB_VM_STATS_H
+
+/* Virtual memory statistics for a process, as returned by the
+   vmstats system call.  The working set size and fault rate are
+   sampled once every SAMPLE_MSECS milliseconds. */
+struct vm_stats
+  {
+    long long fault_cnt;        /* Number of page faults handled. */
+    int fault_rate;             /* Page faults per second over the
+                                   last sampling period. */
+    int resident_cnt;           /* Number of pages in frames. */
+    int rss_limit;              /* Resident set size above which the
+                                   process's pages are evicted
+                                   first. */
+    int working_set;            /* Number of resident pages accessed
+                                   in the last sampling period. */
+    int sample_msecs;           /* Length of sampling period. */
+  };
+
+#endif /* lib/vm-stats.h */
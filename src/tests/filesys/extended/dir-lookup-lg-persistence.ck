@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($fs);
+$fs->{"file$_"} = [''] foreach 0...4999;
+check_archive ($fs);
+pass;
@@ -0,0 +1,46 @@
+/* Creates 5,000 empty files in the root directory, then opens
+   each of them by name in a scattered order, as a benchmark for
+   directory lookup.  Scanning a linear directory makes this
+   quadratic in the number of files, whereas a hashed directory
+   touches a constant number of directory sectors per create and
+   per lookup. */
+
+#include <syscall.h>
+#include <stdio.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 5000
+
+/* Multiplier for visiting files in scattered order.  It must be
+   relatively prime to FILE_CNT. */
+#define STRIDE 7919
+
+void
+test_main (void) 
+{
+  char file_name[16];
+  size_t i;
+
+  msg ("creating %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      snprintf (file_name, sizeof file_name, "file%zu", i);
+      if (!create (file_name, 0))
+        fail ("create \"%s\" failed", file_name);
+    }
+
+  msg ("opening %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      int fd;
+
+      snprintf (file_name, sizeof file_name, "file%zu", i * STRIDE % FILE_CNT);
+      fd = open (file_name);
+      if (fd < 2)
+        fail ("open \"%s\" failed", file_name);
+      close (fd);
+    }
+
+  CHECK (open ("file5000") == -1, "open \"file5000\" (must return -1)");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-lookup-lg) begin
+(dir-lookup-lg) creating 5000 files
+(dir-lookup-lg) opening 5000 files
+(dir-lookup-lg) open "file5000" (must return -1)
+(dir-lookup-lg) end
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Creates a file small enough to be stored inline in its inode,
+   writes to it without growing it past that size, checks its
+   contents, then grows it well past that size and checks its
+   contents again. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define INITIAL_SIZE 200
+#define SMALL_SIZE 400
+#define LARGE_SIZE 1000
+
+static char data[LARGE_SIZE];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (data, sizeof data);
+
+  CHECK (create ("small", INITIAL_SIZE), "create \"small\"");
+  CHECK ((fd = open ("small")) > 1, "open \"small\"");
+  CHECK (write (fd, data, 100) == 100, "write 100 bytes");
+  CHECK (write (fd, data + 100, SMALL_SIZE - 100) == SMALL_SIZE - 100,
+         "write %d bytes at offset 100", SMALL_SIZE - 100);
+  msg ("close \"small\"");
+  close (fd);
+  check_file ("small", data, SMALL_SIZE);
+
+  CHECK ((fd = open ("small")) > 1, "open \"small\"");
+  seek (fd, SMALL_SIZE);
+  CHECK (write (fd, data + SMALL_SIZE, LARGE_SIZE - SMALL_SIZE)
+         == LARGE_SIZE - SMALL_SIZE,
+         "write %d bytes at offset %d", LARGE_SIZE - SMALL_SIZE, SMALL_SIZE);
+  msg ("close \"small\"");
+  close (fd);
+  check_file ("small", data, LARGE_SIZE);
+}
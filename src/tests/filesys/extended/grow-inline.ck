@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-inline) begin
+(grow-inline) create "small"
+(grow-inline) open "small"
+(grow-inline) write 100 bytes
+(grow-inline) write 300 bytes at offset 100
+(grow-inline) close "small"
+(grow-inline) open "small" for verification
+(grow-inline) verified contents of "small"
+(grow-inline) close "small"
+(grow-inline) open "small"
+(grow-inline) write 600 bytes at offset 400
+(grow-inline) close "small"
+(grow-inline) open "small" for verification
+(grow-inline) verified contents of "small"
+(grow-inline) close "small"
+(grow-inline) end
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Creates a 4 MB file, twice the size of the file system disk,
+   which only works if creating a file does not allocate sectors
+   for its data.  Checks that the file reads as zeros, writes a
+   few bytes near its end, reads them back, and removes it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (4 * 1024 * 1024)
+
+static char buf[512];
+static char zeros[sizeof buf];
+
+void
+test_main (void) 
+{
+  static const char data[] = "sparse";
+  size_t ofs;
+  int fd;
+
+  CHECK (create ("sparse", FILE_SIZE), "create \"sparse\"");
+  CHECK ((fd = open ("sparse")) > 1, "open \"sparse\"");
+  CHECK (filesize (fd) == FILE_SIZE, "filesize \"sparse\"");
+
+  msg ("read \"sparse\"");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += 64 * 1024) 
+    {
+      seek (fd, ofs);
+      if (read (fd, buf, sizeof buf) != sizeof buf)
+        fail ("read %zu bytes at offset %zu failed", sizeof buf, ofs);
+      compare_bytes (buf, zeros, sizeof buf, ofs, "sparse");
+    }
+
+  seek (fd, FILE_SIZE - 100);
+  CHECK (write (fd, data, sizeof data) == sizeof data,
+         "write %zu bytes at offset %d", sizeof data, FILE_SIZE - 100);
+  seek (fd, FILE_SIZE - 100);
+  CHECK (read (fd, buf, sizeof data) == sizeof data,
+         "read %zu bytes at offset %d", sizeof data, FILE_SIZE - 100);
+  compare_bytes (buf, data, sizeof data, FILE_SIZE - 100, "sparse");
+
+  msg ("close \"sparse\"");
+  close (fd);
+  CHECK (remove ("sparse"), "remove \"sparse\"");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-sparse-lg) begin
+(grow-sparse-lg) create "sparse"
+(grow-sparse-lg) open "sparse"
+(grow-sparse-lg) filesize "sparse"
+(grow-sparse-lg) read "sparse"
+(grow-sparse-lg) write 7 bytes at offset 4194204
+(grow-sparse-lg) read 7 bytes at offset 4194204
+(grow-sparse-lg) close "sparse"
+(grow-sparse-lg) remove "sparse"
+(grow-sparse-lg) end
+EOF
+pass;
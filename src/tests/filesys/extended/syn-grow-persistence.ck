@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($data) = random_bytes (512 * 128);
+check_archive ({"child-syn-grow" => "tests/filesys/extended/child-syn-grow",
+		"grow-0" => [$data],
+		"grow-1" => [$data],
+		"grow-2" => [$data],
+		"grow-3" => [$data]});
+pass;
@@ -0,0 +1,20 @@
+/* Grows several files in parallel, one per subprocess, each in
+   small chunks, so that the writes to different files are
+   interleaved.  Allocating a sector on every write would then
+   scatter each file across the disk; the test's output reports
+   how many extents each file ended up with and how long it
+   takes to read back. */
+
+#include <syscall.h>
+#include "tests/filesys/extended/syn-grow.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+
+  exec_children ("child-syn-grow", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+}
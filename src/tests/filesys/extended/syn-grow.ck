@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-grow) begin
+(syn-grow) exec child 1 of 4: "child-syn-grow 0"
+(syn-grow) exec child 2 of 4: "child-syn-grow 1"
+(syn-grow) exec child 3 of 4: "child-syn-grow 2"
+(syn-grow) exec child 4 of 4: "child-syn-grow 3"
+(syn-grow) wait for child 1 of 4 returned 0 (expected 0)
+(syn-grow) wait for child 2 of 4 returned 1 (expected 1)
+(syn-grow) wait for child 3 of 4 returned 2 (expected 2)
+(syn-grow) wait for child 4 of 4 returned 3 (expected 3)
+(syn-grow) end
+EOF
+pass;
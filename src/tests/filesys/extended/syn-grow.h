@@ -0,0 +1,9 @@
+#ifndef TESTS_FILESYS_EXTENDED_SYN_GROW_H
+#define TESTS_FILESYS_EXTENDED_SYN_GROW_H
+
+#define CHUNK_SIZE 512
+#define CHUNK_CNT 128
+#define BUF_SIZE (CHUNK_SIZE * CHUNK_CNT)
+#define CHILD_CNT 4
+
+#endif /* tests/filesys/extended/syn-grow.h */
@@ -0,0 +1,82 @@
+/* Creates files while another thread keeps looking up the names
+   of files that are about to be created, so that negative
+   entries for them keep being added to the directory entry
+   cache.  Each file must be found as soon as it has been
+   created, however the two threads interleave. */
+
+#include <stdio.h>
+#include "tests/filesys/kernel/tests.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define FILE_CNT 200
+
+/* Number of names past the last file created that the looking
+   thread probes. */
+#define LOOKAHEAD 4
+
+static volatile int created_cnt;
+static volatile bool done;
+
+/* Repeatedly looks up names that do not exist yet, until the
+   main thread is done, then ups the semaphore in AUX_. */
+static void
+lookup_thread (void *aux_) 
+{
+  struct semaphore *finished = aux_;
+  char file_name[16];
+
+  while (!done) 
+    {
+      int i;
+
+      for (i = created_cnt; i < created_cnt + LOOKAHEAD; i++) 
+        {
+          snprintf (file_name, sizeof file_name, "race%d", i);
+          file_close (filesys_open (file_name));
+        }
+      thread_yield ();
+    }
+  sema_up (finished);
+}
+
+void
+test_dcache_race (void) 
+{
+  struct semaphore finished;
+  char file_name[16];
+  int i;
+
+  sema_init (&finished, 0);
+  thread_create ("lookup", PRI_DEFAULT, lookup_thread, &finished);
+
+  msg ("creating %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      struct file *file;
+
+      snprintf (file_name, sizeof file_name, "race%d", i);
+      CHECK (filesys_create (file_name, 0), "create \"%s\"", file_name);
+      file = filesys_open (file_name);
+      CHECK (file != NULL, "open \"%s\" just after creating it", file_name);
+      file_close (file);
+      created_cnt = i + 1;
+      thread_yield ();
+    }
+  done = true;
+  sema_down (&finished);
+
+  msg ("opening %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      struct file *file;
+
+      snprintf (file_name, sizeof file_name, "race%d", i);
+      file = filesys_open (file_name);
+      CHECK (file != NULL, "open \"%s\"", file_name);
+      file_close (file);
+    }
+  pass ();
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dcache-race) begin
+(dcache-race) creating 200 files
+(dcache-race) opening 200 files
+(dcache-race) PASS
+(dcache-race) end
+EOF
+pass;
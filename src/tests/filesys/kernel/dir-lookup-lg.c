@@ -0,0 +1,64 @@
+/* Creates 5,000 empty files in the root directory, so that its
+   hashed index splits many times, then opens each of them by
+   name in a scattered order.  Removes every other file and
+   checks that exactly the remaining ones can still be found. */
+
+#include <stdio.h>
+#include "tests/filesys/kernel/tests.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+
+#define FILE_CNT 5000
+
+/* Multiplier for visiting files in scattered order.  It must be
+   relatively prime to FILE_CNT. */
+#define STRIDE 7919
+
+void
+test_dir_lookup_lg (void) 
+{
+  char file_name[16];
+  size_t i;
+
+  msg ("creating %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      snprintf (file_name, sizeof file_name, "file%zu", i);
+      CHECK (filesys_create (file_name, 0), "create \"%s\"", file_name);
+    }
+
+  msg ("opening %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      struct file *file;
+
+      snprintf (file_name, sizeof file_name, "file%zu",
+                i * STRIDE % FILE_CNT);
+      file = filesys_open (file_name);
+      CHECK (file != NULL, "open \"%s\"", file_name);
+      file_close (file);
+    }
+  CHECK (filesys_open ("file5000") == NULL,
+         "open \"file1000\" must fail");
+
+  msg ("removing %d files", FILE_CNT / 2);
+  for (i = 0; i < FILE_CNT; i += 2) 
+    {
+      snprintf (file_name, sizeof file_name, "file%zu", i);
+      CHECK (filesys_remove (file_name), "remove \"%s\"", file_name);
+    }
+
+  msg ("opening %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      struct file *file;
+
+      snprintf (file_name, sizeof file_name, "file%zu", i);
+      file = filesys_open (file_name);
+      CHECK ((file != NULL) == (i % 2 == 1),
+             "open \"%s\" should %s", file_name,
+             i % 2 == 1 ? "succeed" : "fail");
+      file_close (file);
+    }
+  pass ();
+}
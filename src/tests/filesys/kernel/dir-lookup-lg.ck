@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dir-lookup-lg) begin
+(dir-lookup-lg) creating 5000 files
+(dir-lookup-lg) opening 5000 files
+(dir-lookup-lg) removing 2500 files
+(dir-lookup-lg) opening 5000 files
+(dir-lookup-lg) PASS
+(dir-lookup-lg) end
+EOF
+pass;
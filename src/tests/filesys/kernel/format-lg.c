@@ -0,0 +1,59 @@
+/* Runs on an 8 MB disk, whose free map is too big to be stored
+   inline in its inode, so formatting it must give the free map
+   file sectors of its own.  Then writes a file that spans most
+   of the disk, so that allocating its sectors updates every
+   sector of the free map, and checks its contents. */
+
+#include <stdint.h>
+#include <string.h>
+#include "tests/filesys/kernel/tests.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+
+#define FILE_SIZE (6 * 1024 * 1024)
+#define CHUNK_SIZE 4096
+
+static uint8_t expected[CHUNK_SIZE];
+static uint8_t actual[CHUNK_SIZE];
+
+/* Fills EXPECTED with the bytes of the file at offset OFS. */
+static void
+fill_chunk (off_t ofs) 
+{
+  size_t i;
+
+  for (i = 0; i < CHUNK_SIZE; i++)
+    expected[i] = (ofs + i) * 7 + (ofs + i) / 509;
+}
+
+void
+test_format_lg (void) 
+{
+  struct file *file;
+  off_t ofs;
+
+  CHECK (filesys_create ("big", 0), "create \"big\"");
+  CHECK ((file = filesys_open ("big")) != NULL, "open \"big\"");
+  msg ("write \"big\"");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE) 
+    {
+      fill_chunk (ofs);
+      CHECK (file_write_at (file, expected, CHUNK_SIZE, ofs) == CHUNK_SIZE,
+             "write %d bytes at offset %d", CHUNK_SIZE, ofs);
+    }
+  file_close (file);
+
+  msg ("check \"big\"");
+  CHECK ((file = filesys_open ("big")) != NULL, "open \"big\"");
+  CHECK (file_length (file) == FILE_SIZE, "filesize \"big\"");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE) 
+    {
+      fill_chunk (ofs);
+      CHECK (file_read_at (file, actual, CHUNK_SIZE, ofs) == CHUNK_SIZE,
+             "read %d bytes at offset %d", CHUNK_SIZE, ofs);
+      CHECK (!memcmp (actual, expected, CHUNK_SIZE),
+             "\"big\" has wrong contents at offset %d", ofs);
+    }
+  file_close (file);
+  pass ();
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(format-lg) begin
+(format-lg) write "big"
+(format-lg) check "big"
+(format-lg) PASS
+(format-lg) end
+EOF
+pass;
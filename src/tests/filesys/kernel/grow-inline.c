@@ -0,0 +1,43 @@
+/* Creates a file small enough to be stored inline in its inode,
+   writes to it without growing it past that size, checks its
+   contents, then grows it well past that size and checks its
+   contents again. */
+
+#include <random.h>
+#include "tests/filesys/kernel/tests.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+
+#define INITIAL_SIZE 200
+#define SMALL_SIZE 400
+#define LARGE_SIZE 1000
+
+static char data[LARGE_SIZE];
+
+void
+test_grow_inline (void) 
+{
+  struct file *file;
+
+  random_init (0);
+  random_bytes (data, sizeof data);
+
+  CHECK (filesys_create ("small", INITIAL_SIZE), "create \"small\"");
+  CHECK ((file = filesys_open ("small")) != NULL, "open \"small\"");
+  CHECK (file_write (file, data, 100) == 100, "write 100 bytes");
+  CHECK (file_write (file, data + 100, SMALL_SIZE - 100) == SMALL_SIZE - 100,
+         "write %d bytes at offset 100", SMALL_SIZE - 100);
+  msg ("close \"small\"");
+  file_close (file);
+  check_file ("small", data, SMALL_SIZE);
+
+  CHECK ((file = filesys_open ("small")) != NULL, "open \"small\"");
+  file_seek (file, SMALL_SIZE);
+  CHECK (file_write (file, data + SMALL_SIZE, LARGE_SIZE - SMALL_SIZE)
+         == LARGE_SIZE - SMALL_SIZE,
+         "write %d bytes at offset %d", LARGE_SIZE - SMALL_SIZE, SMALL_SIZE);
+  msg ("close \"small\"");
+  file_close (file);
+  check_file ("small", data, LARGE_SIZE);
+  pass ();
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(grow-inline) begin
+(grow-inline) close "small"
+(grow-inline) close "small"
+(grow-inline) PASS
+(grow-inline) end
+EOF
+pass;
@@ -0,0 +1,48 @@
+/* Creates a 4 MB file, twice the size of the file system disk,
+   which only works if creating a file does not allocate sectors
+   for its data.  Checks that the file reads as zeros, writes a
+   few bytes near its end, reads them back, and removes it. */
+
+#include <string.h>
+#include "tests/filesys/kernel/tests.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+
+#define FILE_SIZE (4 * 1024 * 1024)
+
+static char buf[512];
+static char zeros[sizeof buf];
+
+void
+test_grow_sparse_lg (void) 
+{
+  static const char data[] = "sparse";
+  struct file *file;
+  off_t ofs;
+
+  CHECK (filesys_create ("sparse", FILE_SIZE), "create \"sparse\"");
+  CHECK ((file = filesys_open ("sparse")) != NULL, "open \"sparse\"");
+  CHECK (file_length (file) == FILE_SIZE, "filesize \"sparse\"");
+
+  msg ("read \"sparse\"");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += 64 * 1024) 
+    {
+      CHECK (file_read_at (file, buf, sizeof buf, ofs) == sizeof buf,
+             "read %zu bytes at offset %d", sizeof buf, ofs);
+      CHECK (!memcmp (buf, zeros, sizeof buf),
+             "\"sparse\" is not zero at offset %d", ofs);
+    }
+
+  CHECK (file_write_at (file, data, sizeof data, FILE_SIZE - 100)
+         == sizeof data,
+         "write %zu bytes at offset %d", sizeof data, FILE_SIZE - 100);
+  CHECK (file_read_at (file, buf, sizeof data, FILE_SIZE - 100)
+         == sizeof data,
+         "read %zu bytes at offset %d", sizeof data, FILE_SIZE - 100);
+  CHECK (!memcmp (buf, data, sizeof data), "\"sparse\" has wrong contents");
+
+  msg ("close \"sparse\"");
+  file_close (file);
+  CHECK (filesys_remove ("sparse"), "remove \"sparse\"");
+  pass ();
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(grow-sparse-lg) begin
+(grow-sparse-lg) read "sparse"
+(grow-sparse-lg) close "sparse"
+(grow-sparse-lg) PASS
+(grow-sparse-lg) end
+EOF
+pass;
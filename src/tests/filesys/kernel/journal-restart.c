@@ -0,0 +1,123 @@
+/* Runs long operations, which restart their transactions many
+   times, alongside short ones that keep each transaction open.
+   One thread preallocates a large file and then removes another
+   one, while other threads keep creating small files and writing
+   to the large file, so that they join transactions and then
+   wait for the large file's lock.  Finally checks the small
+   files' contents. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/filesys/kernel/tests.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define BIG_SIZE (1024 * 1024)
+#define OLD_SIZE (640 * 1024)
+#define SMALL_THREADS 3
+#define SMALL_CNT 20
+#define SMALL_SIZE 100
+
+static struct semaphore finished;
+
+/* Creates a file named NAME and preallocates LENGTH bytes for
+   it. */
+static void
+create_big (const char *name, off_t length) 
+{
+  struct file *file;
+
+  CHECK (filesys_create (name, 0), "create \"%s\"", name);
+  file = filesys_open (name);
+  CHECK (file != NULL, "open \"%s\"", name);
+  CHECK (inode_preallocate (file_get_inode (file), length),
+         "preallocate %d bytes for \"%s\"", length, name);
+  file_close (file);
+}
+
+/* Grows "big" and then removes "old". */
+static void
+long_thread (void *aux UNUSED) 
+{
+  create_big ("big", BIG_SIZE);
+  CHECK (filesys_remove ("old"), "remove \"old\"");
+  sema_up (&finished);
+}
+
+/* Returns the name of small file J written by thread I. */
+static const char *
+small_name (int i, int j) 
+{
+  static char names[SMALL_THREADS][16];
+  snprintf (names[i], sizeof names[i], "s%d-%d", i, j);
+  return names[i];
+}
+
+/* Fills BUF with the contents of small file J of thread I. */
+static void
+small_contents (uint8_t buf[SMALL_SIZE], int i, int j) 
+{
+  int k;
+
+  for (k = 0; k < SMALL_SIZE; k++)
+    buf[k] = i * 31 + j * 7 + k;
+}
+
+/* Creates small files, writing a sector of "big" after each
+   one, for the thread whose index is in AUX. */
+static void
+small_thread (void *aux) 
+{
+  int i = (int) aux;
+  uint8_t buf[SMALL_SIZE];
+  int j;
+
+  for (j = 0; j < SMALL_CNT; j++) 
+    {
+      struct file *big;
+
+      small_contents (buf, i, j);
+      create_file (small_name (i, j), buf, sizeof buf);
+
+      big = filesys_open ("big");
+      if (big != NULL) 
+        {
+          off_t ofs = (i * SMALL_CNT + j) * 512;
+          CHECK (file_write_at (big, buf, sizeof buf, ofs) == sizeof buf,
+                 "write \"big\" at %d", ofs);
+          file_close (big);
+        }
+      thread_yield ();
+    }
+  sema_up (&finished);
+}
+
+void
+test_journal_restart (void) 
+{
+  uint8_t buf[SMALL_SIZE];
+  int i, j;
+
+  create_big ("old", OLD_SIZE);
+
+  msg ("running long and short operations together");
+  sema_init (&finished, 0);
+  thread_create ("long", PRI_DEFAULT, long_thread, NULL);
+  for (i = 0; i < SMALL_THREADS; i++)
+    thread_create ("small", PRI_DEFAULT, small_thread, (void *) i);
+  for (i = 0; i < SMALL_THREADS + 1; i++)
+    sema_down (&finished);
+
+  msg ("checking files");
+  CHECK (filesys_open ("old") == NULL, "\"old\" still exists");
+  for (i = 0; i < SMALL_THREADS; i++)
+    for (j = 0; j < SMALL_CNT; j++) 
+      {
+        small_contents (buf, i, j);
+        check_file (small_name (i, j), buf, sizeof buf);
+      }
+  pass ();
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(journal-restart) begin
+(journal-restart) running long and short operations together
+(journal-restart) checking files
+(journal-restart) PASS
+(journal-restart) end
+EOF
+pass;
@@ -0,0 +1,125 @@
+/* Grows several files in parallel, one per thread, in small
+   chunks, closing each file after every chunk so that its
+   delayed blocks are flushed on close.  Meanwhile another thread
+   keeps opening the files and checking that everything written
+   so far reads back correctly, so that opens race with the
+   closes that give delayed blocks their sectors.  Finally checks
+   the files' contents. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/filesys/kernel/tests.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define FILE_CNT 4
+#define CHUNK_SIZE 700
+#define CHUNK_CNT 40
+#define FILE_SIZE (CHUNK_SIZE * CHUNK_CNT)
+
+/* Contents of file I.  Each byte depends on its file and offset. */
+static uint8_t contents[FILE_CNT][FILE_SIZE];
+
+/* Number of chunks written to each file and closed. */
+static volatile int written_cnt[FILE_CNT];
+
+static struct semaphore finished;
+
+/* Returns the name of file I. */
+static const char *
+file_name (int i) 
+{
+  static char names[FILE_CNT][16];
+  snprintf (names[i], sizeof names[i], "grow%d", i);
+  return names[i];
+}
+
+/* Writes the file whose index is in AUX one chunk at a time,
+   reopening it for each chunk. */
+static void
+grow_thread (void *aux) 
+{
+  int i = (int) aux;
+  int chunk;
+
+  for (chunk = 0; chunk < CHUNK_CNT; chunk++) 
+    {
+      struct file *file = filesys_open (file_name (i));
+      off_t ofs = chunk * CHUNK_SIZE;
+
+      CHECK (file != NULL, "open \"%s\"", file_name (i));
+      CHECK (file_write_at (file, contents[i] + ofs, CHUNK_SIZE, ofs)
+             == CHUNK_SIZE, "write \"%s\" at %d", file_name (i), ofs);
+      file_close (file);
+      written_cnt[i] = chunk + 1;
+      thread_yield ();
+    }
+  sema_up (&finished);
+}
+
+/* Keeps reading back what has been written of each file until
+   every file is complete. */
+static void
+check_thread (void *aux UNUSED) 
+{
+  uint8_t *buf = malloc (FILE_SIZE);
+  bool done;
+
+  CHECK (buf != NULL, "out of memory");
+  do 
+    {
+      int i;
+
+      done = true;
+      for (i = 0; i < FILE_CNT; i++) 
+        {
+          off_t size = written_cnt[i] * CHUNK_SIZE;
+          struct file *file = filesys_open (file_name (i));
+
+          CHECK (file != NULL, "open \"%s\"", file_name (i));
+          CHECK (file_read_at (file, buf, size, 0) == size,
+                 "read %d bytes from \"%s\"", size, file_name (i));
+          CHECK (memcmp (buf, contents[i], size) == 0,
+                 "\"%s\" has wrong contents", file_name (i));
+          file_close (file);
+          if (size < FILE_SIZE)
+            done = false;
+        }
+      thread_yield ();
+    }
+  while (!done);
+  free (buf);
+  sema_up (&finished);
+}
+
+void
+test_syn_grow (void) 
+{
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      size_t j;
+
+      for (j = 0; j < FILE_SIZE; j++)
+        contents[i][j] = i * 37 + j * 7 + j / 251;
+      CHECK (filesys_create (file_name (i), 0), "create \"%s\"",
+             file_name (i));
+    }
+
+  msg ("growing %d files in parallel", FILE_CNT);
+  sema_init (&finished, 0);
+  for (i = 0; i < FILE_CNT; i++)
+    thread_create (file_name (i), PRI_DEFAULT, grow_thread, (void *) i);
+  thread_create ("check", PRI_DEFAULT, check_thread, NULL);
+  for (i = 0; i < FILE_CNT + 1; i++)
+    sema_down (&finished);
+
+  msg ("checking %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    check_file (file_name (i), contents[i], FILE_SIZE);
+  pass ();
+}
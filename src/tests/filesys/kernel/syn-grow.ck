@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(syn-grow) begin
+(syn-grow) growing 4 files in parallel
+(syn-grow) checking 4 files
+(syn-grow) PASS
+(syn-grow) end
+EOF
+pass;
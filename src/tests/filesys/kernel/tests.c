@@ -0,0 +1,123 @@
+#include "tests/filesys/kernel/tests.h"
+#include <debug.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+
+struct test 
+  {
+    const char *name;
+    test_func *function;
+  };
+
+static const struct test tests[] = 
+  {
+    {"dcache-race", test_dcache_race},
+    {"dir-lookup-lg", test_dir_lookup_lg},
+    {"format-lg", test_format_lg},
+    {"grow-inline", test_grow_inline},
+    {"grow-sparse-lg", test_grow_sparse_lg},
+    {"journal-restart", test_journal_restart},
+    {"syn-grow", test_syn_grow},
+  };
+
+static const char *test_name;
+
+/* Runs the test named NAME against the file system, which must
+   have just been formatted. */
+void
+run_fs_test (const char *name) 
+{
+  const struct test *t;
+
+  for (t = tests; t < tests + sizeof tests / sizeof *tests; t++)
+    if (!strcmp (name, t->name))
+      {
+        test_name = name;
+        msg ("begin");
+        t->function ();
+        msg ("end");
+        return;
+      }
+  PANIC ("no test named \"%s\"", name);
+}
+
+/* Prints FORMAT as if with printf(),
+   prefixing the output by the name of the test
+   and following it with a new-line character. */
+void
+msg (const char *format, ...) 
+{
+  va_list args;
+  
+  printf ("(%s) ", test_name);
+  va_start (args, format);
+  vprintf (format, args);
+  va_end (args);
+  putchar ('\n');
+}
+
+/* Prints failure message FORMAT as if with printf(),
+   prefixing the output by the name of the test and FAIL:
+   and following it with a new-line character,
+   and then panics the kernel. */
+void
+fail (const char *format, ...) 
+{
+  va_list args;
+  
+  printf ("(%s) FAIL: ", test_name);
+  va_start (args, format);
+  vprintf (format, args);
+  va_end (args);
+  putchar ('\n');
+
+  PANIC ("test failed");
+}
+
+/* Prints a message indicating the current test passed. */
+void
+pass (void) 
+{
+  printf ("(%s) PASS\n", test_name);
+}
+
+/* Creates a file named NAME holding the SIZE bytes in BUF. */
+void
+create_file (const char *name, const void *buf, size_t size) 
+{
+  struct file *file;
+
+  CHECK (filesys_create (name, 0), "create \"%s\"", name);
+  file = filesys_open (name);
+  CHECK (file != NULL, "open \"%s\"", name);
+  CHECK (file_write (file, buf, size) == (off_t) size,
+         "write %zu bytes to \"%s\"", size, name);
+  file_close (file);
+}
+
+/* Checks that the file named NAME holds exactly the SIZE bytes
+   in BUF. */
+void
+check_file (const char *name, const void *buf, size_t size) 
+{
+  struct file *file;
+  void *data;
+
+  file = filesys_open (name);
+  CHECK (file != NULL, "open \"%s\"", name);
+  CHECK (file_length (file) == (off_t) size,
+         "\"%s\" is %d bytes long, expected %zu",
+         name, file_length (file), size);
+
+  data = malloc (size);
+  CHECK (data != NULL || size == 0, "out of memory checking \"%s\"", name);
+  CHECK (file_read (file, data, size) == (off_t) size,
+         "read %zu bytes from \"%s\"", size, name);
+  CHECK (memcmp (data, buf, size) == 0, "\"%s\" has wrong contents", name);
+  free (data);
+  file_close (file);
+}
@@ -0,0 +1,34 @@
+#ifndef TESTS_FILESYS_KERNEL_TESTS_H
+#define TESTS_FILESYS_KERNEL_TESTS_H
+
+#include <stddef.h>
+
+void run_fs_test (const char *);
+
+typedef void test_func (void);
+
+extern test_func test_dcache_race;
+extern test_func test_dir_lookup_lg;
+extern test_func test_format_lg;
+extern test_func test_grow_inline;
+extern test_func test_grow_sparse_lg;
+extern test_func test_journal_restart;
+extern test_func test_syn_grow;
+
+void msg (const char *, ...);
+void fail (const char *, ...);
+void pass (void);
+
+void create_file (const char *name, const void *buf, size_t size);
+void check_file (const char *name, const void *buf, size_t size);
+
+/* Fails the test with message MSG if SUCCESS is false. */
+#define CHECK(SUCCESS, ...)                     \
+        do                                      \
+          {                                     \
+            if (!(SUCCESS))                     \
+              fail (__VA_ARGS__);               \
+          }                                     \
+        while (0)
+
+#endif /* tests/filesys/kernel/tests.h */
@@ -31,8 +31,15 @@
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "devices/elevator.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "tests/filesys/kernel/tests.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
 #endif
 
 /* Amount of physical memory, in 4 kB pages. */
@@ -87,6 +94,9 @@ main (void)
   palloc_init ();
   malloc_init ();
   paging_init ();
+#ifdef VM
+  frame_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -114,6 +124,10 @@ main (void)
   disk_init ();
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  swap_init ();
+  frame_start_sampler ();
+#endif
 
   printf ("Boot complete.\n");
   
@@ -239,14 +253,30 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-stripe"))
+        filesys_stripe = true;
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+#ifdef FILESYS
+      else if (!strcmp (name, "-pio"))
+        disk_pio_only = true;
+      else if (!strcmp (name, "-fifo"))
+        elevator_fifo = true;
+#endif
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-stack"))
+        page_stack_max = (size_t) atoi (value) * 1024 * 1024;
+      else if (!strcmp (name, "-fa"))
+        page_fault_around = atoi (value);
+      else if (!strcmp (name, "-rss"))
+        frame_rss_limit = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -270,6 +300,19 @@ run_task (char **argv)
   printf ("Execution of '%s' complete.\n", task);
 }
 
+#ifdef FILESYS
+/* Runs the file system test named in ARGV[1]. */
+static void
+run_fs_task (char **argv)
+{
+  const char *task = argv[1];
+
+  printf ("Executing '%s':\n", task);
+  run_fs_test (task);
+  printf ("Execution of '%s' complete.\n", task);
+}
+#endif
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -291,7 +334,11 @@ run_actions (char **argv)
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
       {"rm", 2, fsutil_rm},
+      {"extents", 2, fsutil_extents},
+      {"iobench", 1, fsutil_iobench},
+      {"fstest", 2, run_fs_task},
       {"put", 2, fsutil_put},
+      {"extract", 1, fsutil_extract},
       {"get", 2, fsutil_get},
 #endif
       {NULL, 0, NULL},
@@ -339,18 +386,33 @@ usage (void)
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  extents FILE       Print FILE's extent count and read time.\n"
+          "  iobench            Benchmark concurrent random disk reads.\n"
+          "  fstest TEST        Run file system TEST, after formatting.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  put FILE           Put FILE into file system from scratch disk.\n"
+          "  extract            Extract tar archive from scratch disk into file system.\n"
           "  get FILE           Get FILE from file system into scratch disk.\n"
 #endif
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
           "  -q                 Power off VM after actions or on panic.\n"
           "  -f                 Format file system disk during startup.\n"
+          "  -stripe            Stripe file system across hd0:1 and hd1:1.\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+#ifdef FILESYS
+          "  -pio               Use programmed I/O instead of DMA for disks.\n"
+          "  -fifo              Carry out disk requests in order of arrival.\n"
+#endif
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -stack=MB          Limit user stacks to MB megabytes (default: 8).\n"
+          "  -fa=PAGES          Map up to PAGES pages per fault (default: 16).\n"
+          "  -rss=PAGES         Evict first from processes over PAGES resident\n"
+          "                     pages (default: half of user memory).\n"
 #endif
           );
   power_off ();
@@ -395,4 +457,7 @@ print_stats (void)
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  page_print_stats ();
+#endif
 }
@@ -439,6 +439,15 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+#ifdef USERPROG
+  t->exit_code = -1;
+  list_init (&t->children);
+  list_init (&t->fds);
+  t->next_handle = 2;
+#endif
+#ifdef VM
+  list_init (&t->mappings);
+#endif
   t->magic = THREAD_MAGIC;
 }
 
@@ -95,6 +95,48 @@ struct thread
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    int exit_code;                      /* Exit code. */
+    struct wait_status *wait_status;    /* This process's completion
+                                           status, shared with its
+                                           parent. */
+    struct list children;               /* Completion status of
+                                           children. */
+
+    /* Owned by userprog/syscall.c. */
+    void *user_esp;                     /* User %esp at system call. */
+    struct list fds;                    /* Open file descriptors. */
+    int next_handle;                    /* Next file descriptor. */
+#endif
+
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash *pages;                 /* Supplemental page table. */
+    long long fault_cnt;                /* Page faults handled. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Next mapping id. */
+
+    /* Owned by userprog/process.c. */
+    struct file *bin_file;              /* Executable, for demand paging. */
+
+    /* Owned by vm/frame.c. */
+    struct list_elem process_elem;      /* `processes' list element. */
+    size_t resident_cnt;                /* Pages in frames. */
+    size_t rss_limit;                   /* Soft limit on resident_cnt. */
+    size_t ws_size;                     /* Working set at last sample. */
+    size_t ws_accessed_cnt;             /* Pages accessed so far in the
+                                           current sample. */
+    long long sample_fault_cnt;         /* fault_cnt at last sample. */
+    int fault_rate;                     /* Faults per second at last
+                                           sample. */
+#endif
+
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting depth of operations. */
+    size_t journal_cnt;                 /* Sectors added by operation. */
+    bool journal_dirty;                 /* Operation modified metadata? */
 #endif
 
     /* Owned by thread.c. */
@@ -4,6 +4,10 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -148,6 +152,33 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  /* Bring in the page if it is part of the process's address
+     space but not yet in memory, or if the access grows the
+     stack.  A fault in the kernel, while it accesses user memory
+     during a system call, is judged against the user stack
+     pointer saved on entry to the system call. */
+  if (not_present
+      && page_in (fault_addr,
+                  user ? f->esp : thread_current ()->user_esp, write))
+    return;
+
+  /* Give a copy-on-write page, or one mapped to the zero frame,
+     its own frame on its first write. */
+  if (!not_present && write && page_unshare (fault_addr))
+    return;
+#endif
+
+  /* A fault in the kernel on a user address that is not mapped
+     comes from get_user() in userprog/syscall.c, which expects
+     to continue at the address in %eax with -1 in %eax. */
+  if (!user && is_user_vaddr (fault_addr)) 
+    {
+      f->eip = (void (*) (void)) f->eax;
+      f->eax = 0xffffffff;
+      return;
+    }
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
@@ -7,6 +7,7 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -14,43 +15,92 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
+
+/* The completion status of a process, shared between the
+   process and its parent.  Whichever of the two is done with it
+   last frees it. */
+struct wait_status
+  {
+    struct list_elem elem;      /* Parent's `children' element. */
+    struct lock lock;           /* Protects ref_cnt. */
+    int ref_cnt;                /* Number of the process and its parent
+                                   still holding it, 0 to 2. */
+    tid_t tid;                  /* Process's thread id. */
+    int exit_code;              /* Exit code, once DEAD is upped. */
+    struct semaphore dead;      /* Upped when the process exits. */
+  };
 
-static thread_func start_process NO_RETURN;
-static bool load (const char *cmdline, void (**eip) (void), void **esp);
+/* Passed from process_execute() to start_process(). */
+struct exec_info 
+  {
+    char *cmd_line;             /* Program name and arguments. */
+    struct semaphore loaded;    /* Upped when loading is done. */
+    struct wait_status *wait_status; /* Child's status, or a null
+                                        pointer if loading failed. */
+  };
 
-/* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+static thread_func start_process NO_RETURN;
+static bool load (const char *cmd_line, void (**eip) (void), void **esp);
+static struct wait_status *wait_status_create (void);
+static void release_wait_status (struct wait_status *);
+
+/* Starts a new thread running a user program loaded from the
+   first word of CMD_LINE, passing it the words of CMD_LINE as
+   arguments, and waits for the program to load.  Returns the new
+   process's thread id, or TID_ERROR if the thread cannot be
+   created or the program cannot be loaded. */
 tid_t
-process_execute (const char *file_name) 
+process_execute (const char *cmd_line) 
 {
-  char *fn_copy;
+  struct exec_info info;
+  char name[16];
   tid_t tid;
 
-  /* Make a copy of FILE_NAME.
+  /* Make a copy of CMD_LINE.
      Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
+  info.cmd_line = palloc_get_page (0);
+  if (info.cmd_line == NULL)
     return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
+  strlcpy (info.cmd_line, cmd_line, PGSIZE);
+  sema_init (&info.loaded, 0);
+  info.wait_status = NULL;
 
-  /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
-  if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
+  /* Name the thread after the program. */
+  strlcpy (name, cmd_line, sizeof name);
+  name[strcspn (name, " ")] = '\0';
+
+  /* Create a new thread to execute CMD_LINE. */
+  tid = thread_create (name, PRI_DEFAULT, start_process, &info);
+  if (tid != TID_ERROR) 
+    {
+      sema_down (&info.loaded);
+      if (info.wait_status != NULL)
+        list_push_back (&thread_current ()->children,
+                        &info.wait_status->elem);
+      else
+        tid = TID_ERROR;
+    }
+  palloc_free_page (info.cmd_line);
   return tid;
 }
 
 /* A thread function that loads a user process and makes it start
    running. */
 static void
-start_process (void *f_name)
+start_process (void *info_)
 {
-  char *file_name = f_name;
+  struct exec_info *info = info_;
+  struct thread *t = thread_current ();
   struct intr_frame if_;
   bool success;
 
@@ -59,10 +109,13 @@ start_process (void *f_name)
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp);
+  success = load (info->cmd_line, &if_.eip, &if_.esp);
 
-  /* If load failed, quit. */
-  palloc_free_page (file_name);
+  /* Tell the parent whether it worked.  If load failed, quit. */
+  if (success)
+    success = (t->wait_status = wait_status_create ()) != NULL;
+  info->wait_status = t->wait_status;
+  sema_up (&info->loaded);
   if (!success) 
     thread_exit ();
 
@@ -76,18 +129,145 @@ start_process (void *f_name)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Passed from process_fork() to start_fork(). */
+struct fork_info 
+  {
+    struct thread *parent;      /* Process being duplicated. */
+    struct intr_frame if_;      /* Parent's user registers. */
+    struct semaphore done;      /* Upped when the child is set up. */
+    struct wait_status *wait_status; /* Child's status, or a null
+                                        pointer if it was not set up. */
+  };
+
+static thread_func start_fork NO_RETURN;
+
+/* Starts a new process that is a copy of the current one, whose
+   user registers are in F.  The child's address space shares
+   the parent's pages copy-on-write, so only the supplemental page
+   table is copied.  The child returns from the system call with
+   0 in %eax.  Returns the new process's thread id, or TID_ERROR
+   if the child cannot be created. */
+tid_t
+process_fork (const struct intr_frame *f) 
+{
+  struct fork_info info;
+  tid_t tid;
+
+  info.parent = thread_current ();
+  info.if_ = *f;
+  sema_init (&info.done, 0);
+  info.wait_status = NULL;
+
+  /* The parent waits until the child has copied its page table,
+     which must not change meanwhile. */
+  tid = thread_create (thread_name (), PRI_DEFAULT, start_fork, &info);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+  sema_down (&info.done);
+  if (info.wait_status == NULL)
+    return TID_ERROR;
+  list_push_back (&info.parent->children, &info.wait_status->elem);
+  return tid;
+}
+
+/* A thread function that duplicates the process described by
+   INFO_, a struct fork_info, and makes the copy start running. */
+static void
+start_fork (void *info_) 
+{
+  struct fork_info *info = info_;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = info->if_;
+  bool success = false;
+
+  /* A new page directory starts with the kernel mappings only.
+     Page table entries for user pages are created as the child
+     faults them in. */
+  t->pagedir = pagedir_create ();
+  if (t->pagedir != NULL) 
+    {
+      process_activate ();
+      t->bin_file = file_reopen (info->parent->bin_file);
+      if (t->bin_file != NULL) 
+        {
+          file_deny_write (t->bin_file);
+          success = page_init () && page_fork (info->parent);
+        }
+    }
+  if (success)
+    success = (t->wait_status = wait_status_create ()) != NULL;
+  info->wait_status = t->wait_status;
+  sema_up (&info->done);
+  if (!success)
+    thread_exit ();
+
+  /* Return to user mode as the parent did, but with 0 as the
+     system call's return value. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+#endif
+
+/* Creates and returns the completion status of the current
+   process, with one reference for the process and one for its
+   parent.  Returns a null pointer if memory is exhausted. */
+static struct wait_status *
+wait_status_create (void) 
+{
+  struct wait_status *ws = malloc (sizeof *ws);
+  if (ws != NULL) 
+    {
+      lock_init (&ws->lock);
+      ws->ref_cnt = 2;
+      ws->tid = thread_current ()->tid;
+      ws->exit_code = -1;
+      sema_init (&ws->dead, 0);
+    }
+  return ws;
+}
+
+/* Drops a reference to WS, freeing it if it was the last. */
+static void
+release_wait_status (struct wait_status *ws) 
+{
+  int ref_cnt;
+
+  lock_acquire (&ws->lock);
+  ref_cnt = --ws->ref_cnt;
+  lock_release (&ws->lock);
+  if (ref_cnt == 0)
+    free (ws);
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting.
-
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
 {
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->children); e != list_end (&t->children);
+       e = list_next (e)) 
+    {
+      struct wait_status *ws = list_entry (e, struct wait_status, elem);
+      if (ws->tid == child_tid) 
+        {
+          int exit_code;
+
+          list_remove (e);
+          sema_down (&ws->dead);
+          exit_code = ws->exit_code;
+          release_wait_status (ws);
+          return exit_code;
+        }
+    }
   return -1;
 }
 
@@ -96,8 +276,22 @@ void
 process_exit (void)
 {
   struct thread *curr = thread_current ();
+  struct list_elem *e, *next;
   uint32_t *pd;
 
+  /* Close the process's open files. */
+  syscall_exit ();
+
+#ifdef VM
+  /* Write back and remove file mappings, destroy the process's
+     supplemental page table, which frees its frames, and close
+     the executable that its pages are loaded from. */
+  mmap_exit ();
+  page_exit ();
+  file_close (curr->bin_file);
+  curr->bin_file = NULL;
+#endif
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = curr->pagedir;
@@ -114,6 +308,28 @@ process_exit (void)
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
+
+  /* Give up the children's completion statuses. */
+  for (e = list_begin (&curr->children); e != list_end (&curr->children);
+       e = next) 
+    {
+      struct wait_status *ws = list_entry (e, struct wait_status, elem);
+      next = list_remove (e);
+      release_wait_status (ws);
+    }
+
+  /* Report the exit code to the parent, now that the process's
+     file mappings have been written back. */
+  if (curr->wait_status != NULL) 
+    {
+      struct wait_status *ws = curr->wait_status;
+
+      printf ("%s: exit(%d)\n", curr->name, curr->exit_code);
+      ws->exit_code = curr->exit_code;
+      sema_up (&ws->dead);
+      release_wait_status (ws);
+      curr->wait_status = NULL;
+    }
 }
 
 /* Sets up the CPU for running user code in the current
@@ -195,31 +411,45 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-static bool setup_stack (void **esp);
+static bool setup_stack (const char *cmd_line, void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
-   Stores the executable's entry point into *EIP
+/* Loads an ELF executable, named by the first word of CMD_LINE,
+   into the current thread, with the words of CMD_LINE as its
+   arguments.  Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
    Returns true if successful, false otherwise. */
 bool
-load (const char *file_name, void (**eip) (void), void **esp) 
+load (const char *cmd_line, void (**eip) (void), void **esp) 
 {
   struct thread *t = thread_current ();
   struct Elf32_Ehdr ehdr;
   struct file *file = NULL;
+  char *file_name;
+  size_t name_len;
   off_t file_ofs;
   bool success = false;
   int i;
 
+  /* Extract the program name. */
+  name_len = strcspn (cmd_line, " ");
+  file_name = malloc (name_len + 1);
+  if (file_name == NULL)
+    return false;
+  strlcpy (file_name, cmd_line, name_len + 1);
+
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
   process_activate ();
+#ifdef VM
+  if (!page_init ())
+    goto done;
+#endif
 
   /* Open executable file. */
   file = filesys_open (file_name);
@@ -302,7 +532,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
     }
 
   /* Set up stack. */
-  if (!setup_stack (esp))
+  if (!setup_stack (cmd_line, esp))
     goto done;
 
   /* Start address. */
@@ -311,14 +541,32 @@ load (const char *file_name, void (**eip) (void), void **esp)
   success = true;
 
  done:
-  /* We arrive here whether the load is successful or not. */
+  /* We arrive here whether the load is successful or not.
+     With demand paging, the executable stays open until the
+     process exits, because its pages are read on first access.
+     Writes to it are denied meanwhile, so that its pages read the
+     same whenever they are faulted in and frames holding them
+     can be shared with other processes running it. */
+#ifdef VM
+  if (success) 
+    {
+      file_deny_write (file);
+      t->bin_file = file;
+    }
+  else
+    file_close (file);
+#else
   file_close (file);
+#endif
+  free (file_name);
   return success;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -377,6 +625,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only recorded in the supplemental page
+   table here.  They are read or zeroed by the page fault handler
+   when the process first touches them.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -396,6 +648,19 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Record where the page's contents come from. */
+      struct page *p = page_allocate (upage, !writable);
+      if (p == NULL)
+        return false;
+      if (page_read_bytes > 0) 
+        {
+          p->file = file;
+          p->file_offset = ofs;
+          p->file_bytes = page_read_bytes;
+        }
+      ofs += page_read_bytes;
+#else
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -415,6 +680,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -424,26 +690,126 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+/* Pushes the SIZE bytes in BUF onto the stack in KPAGE, whose
+   page-relative stack pointer is *OFS, and then adjusts *OFS
+   appropriately.  The bytes pushed are rounded to a 32-bit
+   boundary.
+   Returns a pointer to the newly pushed object if successful, a
+   null pointer if it does not fit. */
+static void *
+push (uint8_t *kpage, size_t *ofs, const void *buf, size_t size) 
+{
+  size_t padsize = ROUND_UP (size, sizeof (uint32_t));
+  if (*ofs < padsize)
+    return NULL;
+
+  *ofs -= padsize;
+  memcpy (kpage + *ofs + (padsize - size), buf, size);
+  return kpage + *ofs + (padsize - size);
+}
+
+/* Sets up command line arguments in KPAGE, which will be mapped
+   to UPAGE in user space.  The command line arguments are taken
+   from CMD_LINE, separated by spaces.  Sets *ESP to the initial
+   stack pointer for the process.
+   Returns true if successful, false if the arguments do not fit
+   in a page. */
+static bool
+init_cmd_line (uint8_t *kpage, uint8_t *upage, const char *cmd_line,
+               void **esp) 
+{
+  size_t ofs = PGSIZE;
+  char *const null = NULL;
+  char *cmd_line_copy;
+  char *karg, *saveptr;
+  char **kargv;
+  char **argv;
+  int argc, i;
+
+  /* Push command line string. */
+  cmd_line_copy = push (kpage, &ofs, cmd_line, strlen (cmd_line) + 1);
+  if (cmd_line_copy == NULL)
+    return false;
+
+  /* Push argv[argc], then the arguments, which strtok_r() yields
+     in the opposite of the order they go on the stack. */
+  if (push (kpage, &ofs, &null, sizeof null) == NULL)
+    return false;
+  argc = 0;
+  for (karg = strtok_r (cmd_line_copy, " ", &saveptr); karg != NULL;
+       karg = strtok_r (NULL, " ", &saveptr)) 
+    {
+      void *uarg = upage + (karg - (char *) kpage);
+      if (push (kpage, &ofs, &uarg, sizeof uarg) == NULL)
+        return false;
+      argc++;
+    }
+  kargv = (char **) (kpage + ofs);
+  for (i = 0; i < argc / 2; i++) 
+    {
+      char *tmp = kargv[i];
+      kargv[i] = kargv[argc - 1 - i];
+      kargv[argc - 1 - i] = tmp;
+    }
+
+  /* Push argv, argc, and a null "return address". */
+  argv = (char **) (upage + ofs);
+  if (push (kpage, &ofs, &argv, sizeof argv) == NULL
+      || push (kpage, &ofs, &argc, sizeof argc) == NULL
+      || push (kpage, &ofs, &null, sizeof null) == NULL)
+    return false;
+
+  *esp = upage + ofs;
+  return true;
+}
+
+/* Create a stack by mapping a page at the top of user virtual
+   memory, and lay out the arguments in CMD_LINE on it for the
+   process's main(). */
 static bool
-setup_stack (void **esp) 
+setup_stack (const char *cmd_line, void **esp) 
 {
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+#ifdef VM
+  struct page *p = page_allocate (upage, false);
+  bool success;
+
+  if (p == NULL)
+    return false;
+
+  /* Bring the page in and keep it locked while filling it in.
+     It may be evicted again before we get the lock. */
+  do
+    {
+      if (!page_in (upage, PHYS_BASE, true))
+        return false;
+      frame_lock (p);
+    }
+  while (p->frame == NULL);
+  success = init_cmd_line (p->frame->base, upage, cmd_line, esp);
+
+  /* The page was written through its kernel address, so the page
+     table does not know it is dirty. */
+  pagedir_set_dirty (thread_current ()->pagedir, upage, true);
+  frame_unlock (p->frame);
+  return success;
+#else
   uint8_t *kpage;
   bool success = false;
 
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL) 
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
+      if (install_page (upage, kpage, true))
+        success = init_cmd_line (kpage, upage, cmd_line, esp);
       else
         palloc_free_page (kpage);
     }
   return success;
+#endif
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -463,3 +829,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
@@ -1,10 +1,42 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <disk-stats.h>
+#include <list.h>
 #include <syscall-nr.h>
+#include <vm-stats.h>
+#include "userprog/process.h"
+#include "devices/disk.h"
+#include "devices/input.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#endif
+
+/* A file opened by a user process. */
+struct file_descriptor
+  {
+    struct list_elem elem;      /* struct thread `fds' element. */
+    int handle;                 /* File handle. */
+    struct file *file;          /* File. */
+  };
 
 static void syscall_handler (struct intr_frame *);
+static bool copy_in (void *, const void *, size_t);
+static char *copy_in_string (const char *);
+static bool copy_out (void *, const void *, size_t);
+static int open_fd (const char *);
+static struct file_descriptor *lookup_fd (int handle);
+static void close_fd (struct file_descriptor *);
+static int read_fd (int handle, uint8_t *, unsigned size);
+static int write_fd (int handle, const uint8_t *, unsigned size);
 
 void
 syscall_init (void) 
@@ -12,9 +44,442 @@ syscall_init (void)
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
+/* Closes all of the current process's open files. */
+void
+syscall_exit (void) 
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->fds))
+    close_fd (list_entry (list_front (&t->fds),
+                          struct file_descriptor, elem));
+}
+
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+syscall_handler (struct intr_frame *f) 
 {
-  printf ("system call!\n");
+  int number;
+
+  /* Save the user stack pointer for page faults taken in the
+     kernel on behalf of the process. */
+  thread_current ()->user_esp = f->esp;
+
+  if (copy_in (&number, f->esp, sizeof number))
+    switch (number) 
+      {
+      case SYS_HALT:
+        power_off ();
+      case SYS_EXIT:
+        {
+          int status;
+
+          if (!copy_in (&status, (uint32_t *) f->esp + 1, sizeof status))
+            break;
+          thread_current ()->exit_code = status;
+          thread_exit ();
+        }
+      case SYS_EXEC:
+        {
+          const char *ucmd_line;
+          char *kcmd_line;
+
+          if (!copy_in (&ucmd_line, (uint32_t *) f->esp + 1, sizeof ucmd_line)
+              || (kcmd_line = copy_in_string (ucmd_line)) == NULL)
+            break;
+          f->eax = process_execute (kcmd_line);
+          palloc_free_page (kcmd_line);
+          return;
+        }
+      case SYS_WAIT:
+        {
+          tid_t child;
+
+          if (!copy_in (&child, (uint32_t *) f->esp + 1, sizeof child))
+            break;
+          f->eax = process_wait (child);
+          return;
+        }
+      case SYS_CREATE:
+        {
+          const char *ufile;
+          char *kfile;
+          unsigned initial_size;
+
+          if (!copy_in (&ufile, (uint32_t *) f->esp + 1, sizeof ufile)
+              || !copy_in (&initial_size, (uint32_t *) f->esp + 2,
+                           sizeof initial_size)
+              || (kfile = copy_in_string (ufile)) == NULL)
+            break;
+          f->eax = filesys_create (kfile, initial_size);
+          palloc_free_page (kfile);
+          return;
+        }
+      case SYS_REMOVE:
+        {
+          const char *ufile;
+          char *kfile;
+
+          if (!copy_in (&ufile, (uint32_t *) f->esp + 1, sizeof ufile)
+              || (kfile = copy_in_string (ufile)) == NULL)
+            break;
+          f->eax = filesys_remove (kfile);
+          palloc_free_page (kfile);
+          return;
+        }
+#ifdef VM
+      case SYS_FORK:
+        f->eax = process_fork (f);
+        return;
+      case SYS_VMSTATS:
+        {
+          struct vm_stats *ustats, stats;
+
+          if (!copy_in (&ustats, (uint32_t *) f->esp + 1, sizeof ustats))
+            break;
+          frame_get_stats (&stats);
+          f->eax = copy_out (ustats, &stats, sizeof stats);
+          return;
+        }
+#endif
+      case SYS_OPEN:
+        {
+          const char *ufile;
+          char *kfile;
+
+          if (!copy_in (&ufile, (uint32_t *) f->esp + 1, sizeof ufile)
+              || (kfile = copy_in_string (ufile)) == NULL)
+            break;
+          f->eax = open_fd (kfile);
+          palloc_free_page (kfile);
+          return;
+        }
+      case SYS_FILESIZE:
+      case SYS_TELL:
+        {
+          struct file_descriptor *fd;
+          int handle;
+
+          if (!copy_in (&handle, (uint32_t *) f->esp + 1, sizeof handle))
+            break;
+          fd = lookup_fd (handle);
+          if (fd == NULL)
+            f->eax = -1;
+          else if (number == SYS_FILESIZE)
+            f->eax = file_length (fd->file);
+          else
+            f->eax = file_tell (fd->file);
+          return;
+        }
+      case SYS_READ:
+      case SYS_WRITE:
+        {
+          int handle;
+          uint8_t *ubuf;
+          unsigned size;
+
+          if (!copy_in (&handle, (uint32_t *) f->esp + 1, sizeof handle)
+              || !copy_in (&ubuf, (uint32_t *) f->esp + 2, sizeof ubuf)
+              || !copy_in (&size, (uint32_t *) f->esp + 3, sizeof size))
+            break;
+          if (number == SYS_READ)
+            f->eax = read_fd (handle, ubuf, size);
+          else
+            f->eax = write_fd (handle, ubuf, size);
+          return;
+        }
+      case SYS_SEEK:
+        {
+          struct file_descriptor *fd;
+          int handle;
+          unsigned position;
+
+          if (!copy_in (&handle, (uint32_t *) f->esp + 1, sizeof handle)
+              || !copy_in (&position, (uint32_t *) f->esp + 2,
+                           sizeof position))
+            break;
+          fd = lookup_fd (handle);
+          if (fd != NULL)
+            file_seek (fd->file, position);
+          return;
+        }
+      case SYS_CLOSE:
+        {
+          struct file_descriptor *fd;
+          int handle;
+
+          if (!copy_in (&handle, (uint32_t *) f->esp + 1, sizeof handle))
+            break;
+          fd = lookup_fd (handle);
+          if (fd != NULL)
+            close_fd (fd);
+          return;
+        }
+#ifdef VM
+      case SYS_MMAP:
+        {
+          struct file_descriptor *fd;
+          int handle;
+          void *addr;
+
+          if (!copy_in (&handle, (uint32_t *) f->esp + 1, sizeof handle)
+              || !copy_in (&addr, (uint32_t *) f->esp + 2, sizeof addr))
+            break;
+          fd = lookup_fd (handle);
+          f->eax = fd != NULL ? mmap_map (fd->file, addr) : MAP_FAILED;
+          return;
+        }
+      case SYS_MUNMAP:
+        {
+          mapid_t mapping;
+
+          if (!copy_in (&mapping, (uint32_t *) f->esp + 1, sizeof mapping))
+            break;
+          mmap_unmap (mapping);
+          return;
+        }
+#endif
+      case SYS_DISKSTATS:
+        {
+          struct disk_stats *ustats, stats;
+          int chan_no, dev_no;
+          struct disk *d = NULL;
+
+          if (!copy_in (&chan_no, (uint32_t *) f->esp + 1, sizeof chan_no)
+              || !copy_in (&dev_no, (uint32_t *) f->esp + 2, sizeof dev_no)
+              || !copy_in (&ustats, (uint32_t *) f->esp + 3, sizeof ustats))
+            break;
+          if (chan_no >= 0 && (dev_no == 0 || dev_no == 1))
+            d = disk_get (chan_no, dev_no);
+          if (d == NULL) 
+            {
+              f->eax = false;
+              return;
+            }
+          disk_get_stats (d, &stats);
+          f->eax = copy_out (ustats, &stats, sizeof stats);
+          return;
+        }
+      default:
+        break;
+      }
+
+  /* Unknown system call, or bad arguments: kill the process. */
   thread_exit ();
 }
+
+/* Reads a byte at user virtual address UADDR, which must be below
+   PHYS_BASE.  Returns the byte value if successful, -1 if UADDR
+   is not mapped.  If the access faults, page_fault() resumes
+   execution at the address loaded into %eax with -1 in %eax. */
+static inline int
+get_user (const uint8_t *uaddr) 
+{
+  int result;
+  asm ("movl $1f, %0; movzbl %1, %0; 1:" : "=&a" (result) : "m" (*uaddr));
+  return result;
+}
+
+/* Writes BYTE to user address UDST, which must be below
+   PHYS_BASE.  Returns true if successful, false if UDST is not
+   mapped writable.  Faults are handled as in get_user(). */
+static inline bool
+put_user (uint8_t *udst, uint8_t byte) 
+{
+  int error_code;
+  asm ("movl $1f, %0; movb %b2, %1; 1:"
+       : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+  return error_code != -1;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Returns true if successful, false if USRC is not valid
+   user memory. */
+static bool
+copy_in (void *dst_, const void *usrc_, size_t size) 
+{
+  uint8_t *dst = dst_;
+  const uint8_t *usrc = usrc_;
+
+  for (; size > 0; size--, dst++, usrc++) 
+    {
+      int byte;
+
+      if (!is_user_vaddr (usrc) || (byte = get_user (usrc)) == -1)
+        return false;
+      *dst = byte;
+    }
+  return true;
+}
+
+/* Creates a copy of user string US in kernel memory and returns
+   it as a page that must be freed with palloc_free_page().
+   Returns a null pointer if US is not valid user memory or is
+   too long to fit in a page. */
+static char *
+copy_in_string (const char *us) 
+{
+  char *ks;
+  size_t length;
+
+  ks = palloc_get_page (0);
+  if (ks == NULL)
+    return NULL;
+  for (length = 0; length < PGSIZE; length++) 
+    {
+      if (!copy_in (ks + length, us + length, 1))
+        break;
+      if (ks[length] == '\0')
+        return ks;
+    }
+  palloc_free_page (ks);
+  return NULL;
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Returns true if successful, false if UDST is not valid
+   user memory. */
+static bool
+copy_out (void *udst_, const void *src_, size_t size) 
+{
+  uint8_t *udst = udst_;
+  const uint8_t *src = src_;
+
+  for (; size > 0; size--, udst++, src++) 
+    if (!is_user_vaddr (udst) || !put_user (udst, *src))
+      return false;
+  return true;
+}
+
+/* Opens the file named NAME for the current process and returns
+   its file descriptor, or -1 if the file could not be opened. */
+static int
+open_fd (const char *name) 
+{
+  struct thread *t = thread_current ();
+  struct file_descriptor *fd;
+
+  fd = malloc (sizeof *fd);
+  if (fd == NULL)
+    return -1;
+  fd->file = filesys_open (name);
+  if (fd->file == NULL) 
+    {
+      free (fd);
+      return -1;
+    }
+  fd->handle = t->next_handle++;
+  list_push_front (&t->fds, &fd->elem);
+  return fd->handle;
+}
+
+/* Returns the current process's file descriptor with the given
+   HANDLE, or a null pointer if there is none. */
+static struct file_descriptor *
+lookup_fd (int handle) 
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->fds); e != list_end (&t->fds);
+       e = list_next (e))
+    {
+      struct file_descriptor *fd
+        = list_entry (e, struct file_descriptor, elem);
+      if (fd->handle == handle)
+        return fd;
+    }
+  return NULL;
+}
+
+/* Closes file descriptor FD and frees it. */
+static void
+close_fd (struct file_descriptor *fd) 
+{
+  list_remove (&fd->elem);
+  file_close (fd->file);
+  free (fd);
+}
+
+/* Reads up to SIZE bytes from the file with HANDLE, or from the
+   keyboard if HANDLE is STDIN_FILENO, into user buffer UBUF.
+   Returns the number of bytes read, or -1 if HANDLE is not open.
+   Kills the process if UBUF is not valid user memory. */
+static int
+read_fd (int handle, uint8_t *ubuf, unsigned size) 
+{
+  struct file_descriptor *fd = NULL;
+  uint8_t *kbuf;
+  int total = 0;
+
+  if (handle != STDIN_FILENO && (fd = lookup_fd (handle)) == NULL)
+    return -1;
+  kbuf = palloc_get_page (0);
+  if (kbuf == NULL)
+    return -1;
+  while (size > 0) 
+    {
+      int chunk = size < PGSIZE ? size : PGSIZE;
+      int cnt;
+
+      if (fd != NULL)
+        cnt = file_read (fd->file, kbuf, chunk);
+      else
+        for (cnt = 0; cnt < chunk; cnt++)
+          kbuf[cnt] = input_getc ();
+      if (!copy_out (ubuf, kbuf, cnt)) 
+        {
+          palloc_free_page (kbuf);
+          thread_exit ();
+        }
+      total += cnt;
+      if (cnt < chunk)
+        break;
+      ubuf += cnt;
+      size -= cnt;
+    }
+  palloc_free_page (kbuf);
+  return total;
+}
+
+/* Writes up to SIZE bytes from user buffer UBUF to the file with
+   HANDLE, or to the console if HANDLE is STDOUT_FILENO.  Returns
+   the number of bytes written, or -1 if HANDLE is not open.
+   Kills the process if UBUF is not valid user memory. */
+static int
+write_fd (int handle, const uint8_t *ubuf, unsigned size) 
+{
+  struct file_descriptor *fd = NULL;
+  uint8_t *kbuf;
+  int total = 0;
+
+  if (handle != STDOUT_FILENO && (fd = lookup_fd (handle)) == NULL)
+    return -1;
+  kbuf = palloc_get_page (0);
+  if (kbuf == NULL)
+    return -1;
+  while (size > 0) 
+    {
+      int chunk = size < PGSIZE ? size : PGSIZE;
+      int cnt;
+
+      if (!copy_in (kbuf, ubuf, chunk)) 
+        {
+          palloc_free_page (kbuf);
+          thread_exit ();
+        }
+      if (fd != NULL)
+        cnt = file_write (fd->file, kbuf, chunk);
+      else 
+        {
+          putbuf ((char *) kbuf, chunk);
+          cnt = chunk;
+        }
+      total += cnt;
+      if (cnt < chunk)
+        break;
+      ubuf += cnt;
+      size -= cnt;
+    }
+  palloc_free_page (kbuf);
+  return total;
+}
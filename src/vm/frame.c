@@ -0,0 +1,564 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <vm-stats.h>
+#include "vm/page.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* The frame table: every page in the user pool. */
+static struct frame *frames;
+static size_t frame_cnt;
+
+/* Serializes allocation and eviction, and protects the clock
+   hand and shared_frames.  A thread that holds scan_lock only
+   ever tries to acquire a frame's lock, never waits for it, so a
+   thread that holds a frame's lock may acquire scan_lock. */
+static struct lock scan_lock;
+static size_t hand;
+
+/* Frames that hold shared file data, keyed by inode, offset and
+   length. */
+static struct hash shared_frames;
+
+/* A page of zeros shared by every page that is all zeros and has
+   only been read. */
+void *frame_zero;
+
+/* Resident set size, in pages, above which a process's frames
+   are evicted before those of other processes, or 0 for half of
+   the frame table.  Set with the -rss kernel command-line
+   option. */
+size_t frame_rss_limit;
+
+/* Processes with pages, and the number of them whose resident
+   sets exceed their limits.  Protected by disabling
+   interrupts. */
+static struct list processes;
+static int over_limit_cnt;
+
+/* Working set sampling period, in timer ticks. */
+#define SAMPLE_TICKS (TIMER_FREQ / 4)
+
+static hash_hash_func frame_hash;
+static hash_less_func frame_less;
+
+/* Initializes the frame table, taking every page in the user
+   pool for it except the zero frame. */
+void
+frame_init (void) 
+{
+  void *base;
+
+  lock_init (&scan_lock);
+  list_init (&processes);
+  hash_init (&shared_frames, frame_hash, frame_less, NULL);
+  
+  frames = malloc (sizeof *frames * ram_pages);
+  if (frames == NULL)
+    PANIC ("out of memory allocating page frames");
+
+  frame_zero = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (frame_zero == NULL)
+    PANIC ("out of memory allocating zero frame");
+
+  while ((base = palloc_get_page (PAL_USER)) != NULL) 
+    {
+      struct frame *f = &frames[frame_cnt++];
+      lock_init (&f->lock);
+      f->base = base;
+      list_init (&f->pages);
+      f->inode = NULL;
+    }
+
+  if (frame_rss_limit == 0 || frame_rss_limit > frame_cnt)
+    frame_rss_limit = frame_cnt / 2;
+}
+
+/* Starts tracking the resident set and working set of the
+   current process, which has no pages in frames yet. */
+void
+frame_add_process (void) 
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (t->resident_cnt == 0);
+  t->rss_limit = frame_rss_limit;
+  old_level = intr_disable ();
+  list_push_back (&processes, &t->process_elem);
+  intr_set_level (old_level);
+}
+
+/* Stops tracking the current process, which no longer has any
+   pages in frames. */
+void
+frame_remove_process (void) 
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (t->resident_cnt == 0);
+  old_level = intr_disable ();
+  list_remove (&t->process_elem);
+  intr_set_level (old_level);
+}
+
+/* Adds DELTA to the number of pages that thread T has in
+   frames. */
+static void
+count_resident (struct thread *t, int delta) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool was_over = t->resident_cnt > t->rss_limit;
+
+  t->resident_cnt += delta;
+  if (was_over != (t->resident_cnt > t->rss_limit))
+    over_limit_cnt += was_over ? -1 : 1;
+  intr_set_level (old_level);
+}
+
+/* Adds page P to the pages that map frame F, which must be
+   locked. */
+void
+frame_attach (struct frame *f, struct page *p) 
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  list_push_back (&f->pages, &p->frame_elem);
+  count_resident (p->thread, 1);
+}
+
+/* Removes page P from the pages that map frame F, which must be
+   locked. */
+void
+frame_detach (struct frame *f, struct page *p) 
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  list_remove (&p->frame_elem);
+  count_resident (p->thread, -1);
+}
+
+/* Stops sharing frame F, which must be locked, with pages that
+   fault in the same file data.  The caller must hold
+   scan_lock. */
+static void
+unpublish (struct frame *f) 
+{
+  ASSERT (lock_held_by_current_thread (&scan_lock));
+
+  if (f->inode != NULL) 
+    {
+      hash_delete (&shared_frames, &f->hash_elem);
+      f->inode = NULL;
+    }
+}
+
+/* Tries to lock frame F without waiting.  Fails if F is locked,
+   even if by the current thread, which may be allocating a frame
+   while it holds the lock on another one, as page_unshare() does
+   for the frame it copies. */
+static bool
+try_lock (struct frame *f) 
+{
+  return (!lock_held_by_current_thread (&f->lock)
+          && lock_try_acquire (&f->lock));
+}
+
+/* Finds a free frame, locks it, and assigns it to PAGE.
+   Returns the frame, or a null pointer if no frame is free.
+   The caller must hold scan_lock. */
+static struct frame *
+find_free_frame (struct page *page) 
+{
+  size_t i;
+
+  for (i = 0; i < frame_cnt; i++)
+    {
+      struct frame *f = &frames[i];
+      if (!try_lock (f))
+        continue;
+      if (list_empty (&f->pages)) 
+        {
+          frame_attach (f, page);
+          return f;
+        } 
+      lock_release (&f->lock);
+    }
+  return NULL;
+}
+
+/* Returns true if any page that maps frame F, which must be
+   locked, has been accessed recently, and clears their accessed
+   bits. */
+static bool
+frame_accessed_recently (struct frame *f) 
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (page_accessed_recently (list_entry (e, struct page, frame_elem)))
+      accessed = true;
+  return accessed;
+}
+
+/* Returns true if any page that maps frame F, which must be
+   locked, has been modified. */
+static bool
+frame_is_dirty (struct frame *f) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (page_is_dirty (list_entry (e, struct page, frame_elem)))
+      return true;
+  return false;
+}
+
+/* Returns true if every page that maps frame F, which must be
+   locked, belongs to a process whose resident set exceeds its
+   limit. */
+static bool
+frame_over_limit (struct frame *f) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e)) 
+    {
+      struct thread *t = list_entry (e, struct page, frame_elem)->thread;
+      if (t->resident_cnt <= t->rss_limit)
+        return false;
+    }
+  return true;
+}
+
+/* Evicts every page that maps frame F, which must be locked.
+   Returns true if successful, false on failure. */
+static bool
+evict (struct frame *f) 
+{
+  while (!list_empty (&f->pages)) 
+    {
+      struct page *p = list_entry (list_front (&f->pages),
+                                   struct page, frame_elem);
+      if (!page_out (p))
+        return false;
+      frame_detach (f, p);
+    }
+
+  lock_acquire (&scan_lock);
+  unpublish (f);
+  lock_release (&scan_lock);
+  return true;
+}
+
+/* Tries to allocate and lock a frame for PAGE, evicting one if
+   none is free, but without waiting for one to become evictable.
+   Returns the frame if successful, a null pointer on failure. */
+struct frame *
+frame_try_alloc_and_lock (struct page *page) 
+{
+  struct frame *f;
+  size_t i;
+
+  lock_acquire (&scan_lock);
+
+  /* Find a free frame. */
+  f = find_free_frame (page);
+  if (f != NULL) 
+    {
+      lock_release (&scan_lock);
+      return f;
+    }
+
+  /* No free frame.  Find a frame to evict with the clock
+     algorithm.  If any process's resident set exceeds its limit,
+     the first sweep considers only frames held by such
+     processes, so that a process with a large working set gives
+     up its own frames before it takes those of other processes.
+     The next sweep clears the accessed bits of the pages it
+     passes, giving each of them a second chance.  Clean pages are
+     evicted in preference to dirty ones, which must be written
+     back first, so dirty pages of processes within their limits
+     are only considered on the last sweep. */
+  for (i = over_limit_cnt > 0 ? 0 : frame_cnt; i < frame_cnt * 4; i++) 
+    {
+      /* Get a frame. */
+      f = &frames[hand];
+      if (++hand >= frame_cnt)
+        hand = 0;
+
+      if (!try_lock (f))
+        continue;
+
+      if (list_empty (&f->pages)) 
+        {
+          frame_attach (f, page);
+          lock_release (&scan_lock);
+          return f;
+        } 
+
+      if ((i < frame_cnt && !frame_over_limit (f))
+          || frame_accessed_recently (f)
+          || (i >= frame_cnt && i < frame_cnt * 3 && frame_is_dirty (f))) 
+        {
+          lock_release (&f->lock);
+          continue;
+        }
+          
+      lock_release (&scan_lock);
+      
+      /* Evict this frame. */
+      if (!evict (f))
+        {
+          lock_release (&f->lock);
+          lock_acquire (&scan_lock);
+          continue;
+        }
+
+      frame_attach (f, page);
+      return f;
+    }
+
+  lock_release (&scan_lock);
+  return NULL;
+}
+
+/* Tries really hard to allocate and lock a frame for PAGE.
+   Returns the frame if successful, a null pointer on failure. */
+struct frame *
+frame_alloc_and_lock (struct page *page) 
+{
+  size_t try;
+
+  for (try = 0; try < 3; try++) 
+    {
+      struct frame *f = frame_try_alloc_and_lock (page);
+      if (f != NULL) 
+        {
+          ASSERT (lock_held_by_current_thread (&f->lock));
+          return f; 
+        }
+      timer_msleep (1000);
+    }
+
+  return NULL;
+}
+
+/* Allocates and locks a frame for PAGE only if one is free,
+   without evicting anything.  Returns the frame if successful, a
+   null pointer otherwise. */
+struct frame *
+frame_alloc_free_and_lock (struct page *page) 
+{
+  struct frame *f;
+
+  lock_acquire (&scan_lock);
+  f = find_free_frame (page);
+  lock_release (&scan_lock);
+  return f;
+}
+
+/* Looks for a frame that already holds the LENGTH bytes of read-only
+   data at OFFSET in INODE.  If one exists and is not busy, adds
+   PAGE to the pages that map it and returns it locked.
+   Otherwise, returns a null pointer. */
+struct frame *
+frame_share_and_lock (struct page *page, struct inode *inode,
+                      off_t offset, off_t length) 
+{
+  struct frame key;
+  struct hash_elem *e;
+  struct frame *f = NULL;
+
+  key.inode = inode;
+  key.offset = offset;
+  key.length = length;
+
+  lock_acquire (&scan_lock);
+  e = hash_find (&shared_frames, &key.hash_elem);
+  if (e != NULL) 
+    {
+      f = hash_entry (e, struct frame, hash_elem);
+      if (lock_try_acquire (&f->lock))
+        frame_attach (f, page);
+      else
+        f = NULL;
+    }
+  lock_release (&scan_lock);
+  return f;
+}
+
+/* Offers frame F, which must be locked and hold the LENGTH bytes
+   of read-only data at OFFSET in INODE, to other pages that fault
+   in the same data.  If another frame already holds it, F stays
+   private. */
+void
+frame_publish (struct frame *f, struct inode *inode,
+               off_t offset, off_t length) 
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (f->inode == NULL);
+
+  lock_acquire (&scan_lock);
+  f->inode = inode;
+  f->offset = offset;
+  f->length = length;
+  if (hash_insert (&shared_frames, &f->hash_elem) != NULL)
+    f->inode = NULL;
+  lock_release (&scan_lock);
+}
+
+/* Locks P's frame into memory, if it has one.
+   Upon return, p->frame will not change until P is unlocked. */
+void
+frame_lock (struct page *p) 
+{
+  /* A frame can be asynchronously removed, but never inserted. */
+  struct frame *f = p->frame;
+  if (f != NULL) 
+    {
+      lock_acquire (&f->lock);
+      if (f != p->frame)
+        {
+          lock_release (&f->lock);
+          ASSERT (p->frame == NULL); 
+        } 
+    }
+}
+
+/* Removes page P from the pages that map frame F, and unlocks F.
+   F must be locked for use by the current process.  When no page
+   maps F any longer, F is free for use by another page, and any
+   data in F is lost. */
+void
+frame_free (struct frame *f, struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+          
+  frame_detach (f, p);
+  if (list_empty (&f->pages) && f->inode != NULL) 
+    {
+      lock_acquire (&scan_lock);
+      unpublish (f);
+      lock_release (&scan_lock);
+    }
+  lock_release (&f->lock);
+}
+
+/* Unlocks frame F, allowing it to be evicted.
+   F must be locked for use by the current process. */
+void
+frame_unlock (struct frame *f) 
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  lock_release (&f->lock);
+}
+
+/* Ends a working set sample for thread T. */
+static void
+end_sample (struct thread *t) 
+{
+  t->ws_size = t->ws_accessed_cnt;
+  t->ws_accessed_cnt = 0;
+  t->fault_rate = ((t->fault_cnt - t->sample_fault_cnt)
+                   * TIMER_FREQ / SAMPLE_TICKS);
+  t->sample_fault_cnt = t->fault_cnt;
+}
+
+/* Estimates the working set of every process as the number of
+   its resident pages accessed during a sampling period, and its
+   fault rate over the same period.  Frames that are busy when
+   the sampler passes are skipped, so the estimate may be a
+   little low. */
+static void
+sampler (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      enum intr_level old_level;
+      struct list_elem *e;
+      size_t i;
+
+      timer_sleep (SAMPLE_TICKS);
+
+      for (i = 0; i < frame_cnt; i++) 
+        {
+          struct frame *f = &frames[i];
+
+          if (!lock_try_acquire (&f->lock))
+            continue;
+          for (e = list_begin (&f->pages); e != list_end (&f->pages);
+               e = list_next (e)) 
+            {
+              struct page *p = list_entry (e, struct page, frame_elem);
+              if (page_sample_accessed (p))
+                p->thread->ws_accessed_cnt++;
+            }
+          lock_release (&f->lock);
+        }
+
+      old_level = intr_disable ();
+      for (e = list_begin (&processes); e != list_end (&processes);
+           e = list_next (e))
+        end_sample (list_entry (e, struct thread, process_elem));
+      intr_set_level (old_level);
+    }
+}
+
+/* Starts sampling the working sets of processes.  Must be called
+   after the thread system has been started. */
+void
+frame_start_sampler (void) 
+{
+  thread_create ("sampler", PRI_MAX, sampler, NULL);
+}
+
+/* Fills STATS with the current process's virtual memory
+   statistics. */
+void
+frame_get_stats (struct vm_stats *stats) 
+{
+  struct thread *t = thread_current ();
+
+  stats->fault_cnt = t->fault_cnt;
+  stats->fault_rate = t->fault_rate;
+  stats->resident_cnt = t->resident_cnt;
+  stats->rss_limit = t->rss_limit;
+  stats->working_set = t->ws_size;
+  stats->sample_msecs = SAMPLE_TICKS * 1000 / TIMER_FREQ;
+}
+
+/* Returns a hash value for the shared frame that E refers to. */
+static unsigned
+frame_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct frame *f = hash_entry (e, struct frame, hash_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->offset);
+}
+
+/* Returns true if shared frame A precedes shared frame B. */
+static bool
+frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED) 
+{
+  const struct frame *a = hash_entry (a_, struct frame, hash_elem);
+  const struct frame *b = hash_entry (b_, struct frame, hash_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  else if (a->offset != b->offset)
+    return a->offset < b->offset;
+  else
+    return a->length < b->length;
+}
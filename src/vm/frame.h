@@ -0,0 +1,65 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct inode;
+struct page;
+struct vm_stats;
+
+/* A physical frame in the user pool.
+
+   A frame is free if no page maps it.  Most frames hold a single
+   process's page, but a frame that holds read-only data from a
+   file, such as a page of program text, may be shared by every
+   process that maps the same bytes of the same file.  The number
+   of pages in PAGES is the frame's reference count. */
+struct frame 
+  {
+    struct lock lock;           /* Prevent simultaneous access. */
+    void *base;                 /* Kernel virtual base address. */
+    struct list pages;          /* Pages that map this frame. */
+
+    /* Identity of shared file data.  Changed only with both LOCK
+       and scan_lock held. */
+    struct inode *inode;        /* Inode, or null if not shared. */
+    off_t offset;               /* Offset of data in INODE. */
+    off_t length;               /* Bytes of data from INODE. */
+    struct hash_elem hash_elem; /* `shared_frames' element. */
+  };
+
+/* A page of zeros, outside the frame table, that is mapped
+   read-only for pages that are all zeros and have only been
+   read.  Its contents must never change. */
+extern void *frame_zero;
+
+/* Soft limit on the resident set of each process, in pages. */
+extern size_t frame_rss_limit;
+
+void frame_init (void);
+void frame_start_sampler (void);
+void frame_add_process (void);
+void frame_remove_process (void);
+
+struct frame *frame_alloc_and_lock (struct page *);
+struct frame *frame_try_alloc_and_lock (struct page *);
+struct frame *frame_alloc_free_and_lock (struct page *);
+struct frame *frame_share_and_lock (struct page *, struct inode *,
+                                    off_t offset, off_t length);
+void frame_publish (struct frame *, struct inode *,
+                    off_t offset, off_t length);
+void frame_lock (struct page *);
+void frame_attach (struct frame *, struct page *);
+void frame_detach (struct frame *, struct page *);
+
+void frame_free (struct frame *, struct page *);
+void frame_unlock (struct frame *);
+
+void frame_get_stats (struct vm_stats *);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,133 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include "vm/page.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* A memory-mapped file. */
+struct mapping
+  {
+    struct list_elem elem;      /* struct thread `mappings' element. */
+    mapid_t id;                 /* Mapping id. */
+    struct file *file;          /* File. */
+    uint8_t *base;              /* Start of memory mapping. */
+    size_t page_cnt;            /* Number of pages mapped. */
+  };
+
+/* Returns the current process's mapping with the given ID, or a
+   null pointer if there is none. */
+static struct mapping *
+lookup_mapping (mapid_t id) 
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == id)
+        return m;
+    }
+  return NULL;
+}
+
+/* Removes mapping M from the current process's address space,
+   writing back the pages that were modified, and frees it. */
+static void
+unmap (struct mapping *m) 
+{
+  size_t i;
+
+  list_remove (&m->elem);
+  for (i = 0; i < m->page_cnt; i++)
+    page_deallocate (m->base + i * PGSIZE);
+  file_close (m->file);
+  free (m);
+}
+
+/* Maps FILE into the current process's address space starting
+   at ADDR, which must be page-aligned.  The mapping uses its own
+   file handle, so FILE may be closed afterward.  Pages are read
+   from the file when they are first accessed and written back
+   only if they are modified.  Returns the new mapping's id, or
+   MAP_FAILED if ADDR is not suitable, the file is empty, the
+   mapping would overlap pages already in use or the area that
+   the stack may grow into, or memory is exhausted. */
+mapid_t
+mmap_map (struct file *file, void *addr) 
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length;
+
+  if (addr == NULL || pg_ofs (addr) != 0)
+    return MAP_FAILED;
+  length = file_length (file);
+  if (length == 0)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->file = file_reopen (file);
+  if (m->file == NULL) 
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+  m->id = t->next_mapid++;
+  m->base = addr;
+  m->page_cnt = 0;
+  list_push_front (&t->mappings, &m->elem);
+
+  while (length > 0) 
+    {
+      uint8_t *upage = m->base + m->page_cnt * PGSIZE;
+      struct page *p;
+
+      if (!is_user_vaddr (upage)
+          || upage + PGSIZE > (uint8_t *) PHYS_BASE - page_stack_max
+          || (p = page_allocate (upage, false)) == NULL) 
+        {
+          unmap (m);
+          return MAP_FAILED;
+        }
+      p->private = false;
+      p->file = m->file;
+      p->file_offset = m->page_cnt * PGSIZE;
+      p->file_bytes = length >= PGSIZE ? PGSIZE : length;
+      length -= p->file_bytes;
+      m->page_cnt++;
+    }
+
+  return m->id;
+}
+
+/* Removes the current process's mapping with the given ID.
+   Returns true if successful, false if there is no such
+   mapping. */
+bool
+mmap_unmap (mapid_t id) 
+{
+  struct mapping *m = lookup_mapping (id);
+
+  if (m == NULL)
+    return false;
+  unmap (m);
+  return true;
+}
+
+/* Removes all of the current process's mappings.  Must be called
+   before the process's page table is destroyed. */
+void
+mmap_exit (void) 
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings)) 
+    unmap (list_entry (list_front (&t->mappings), struct mapping, elem));
+}
@@ -0,0 +1,687 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "vm/frame.h"
+#include "vm/swap.h"
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+
+/* Maximum size of a process's stack, in bytes.
+   Set with the -stack kernel command-line option. */
+size_t page_stack_max = 8 * 1024 * 1024;
+
+/* Size of the aligned window of pages around a page faulted in
+   from a file that fault_around() tries to map as well, or 0 to
+   map only the faulting page.  Set with the -fa kernel
+   command-line option. */
+size_t page_fault_around = 16;
+
+/* Number of pages mapped by fault_around(). */
+static long long fault_around_cnt;
+
+/* Number of read faults satisfied by mapping frame_zero. */
+static long long zero_map_cnt;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+
+/* Initializes the current process's page table, which must not
+   already exist.  Returns true if successful, false on memory
+   allocation failure. */
+bool
+page_init (void) 
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->pages == NULL);
+  t->pages = malloc (sizeof *t->pages);
+  if (t->pages == NULL)
+    return false;
+  hash_init (t->pages, page_hash, page_less, NULL);
+  frame_add_process ();
+  return true;
+}
+
+/* Frees page P's frame and swap slot.  If P belongs to a file
+   mapping and was modified, it is written back to its file
+   first. */
+static void
+release_page (struct page *p) 
+{
+  uint32_t *pd = p->thread->pagedir;
+
+  /* Unmap the page first, so that pagedir_destroy() does not free
+     its frame, or frame_zero, as well. */
+  frame_lock (p);
+  pagedir_clear_page (pd, p->addr);
+  if (p->frame != NULL) 
+    {
+      if (!p->private && pagedir_is_dirty (pd, p->addr))
+        file_write_at (p->file, p->frame->base, p->file_bytes,
+                       p->file_offset);
+      frame_free (p->frame, p);
+      p->frame = NULL;
+    }
+  swap_free (p);
+}
+
+/* Destroys a page, which must be in the current process's page
+   table.  Used as a callback for hash_destroy(). */
+static void
+destroy_page (struct hash_elem *e, void *aux UNUSED) 
+{
+  struct page *p = hash_entry (e, struct page, hash_elem);
+
+  release_page (p);
+  free (p);
+}
+
+/* Destroys the current process's page table and frees the frames
+   that hold its pages.  Must be called before the process's page
+   directory is destroyed. */
+void
+page_exit (void) 
+{
+  struct thread *t = thread_current ();
+  struct hash *pages = t->pages;
+
+  if (pages != NULL) 
+    {
+      t->pages = NULL;
+      hash_destroy (pages, destroy_page);
+      free (pages);
+      frame_remove_process ();
+    }
+}
+
+/* Returns the page containing the given virtual ADDRESS in the
+   current process, or a null pointer if no such page exists. */
+static struct page *
+page_for_addr (const void *address) 
+{
+  struct thread *t = thread_current ();
+  struct page p;
+  struct hash_elem *e;
+
+  if (t->pages == NULL || !is_user_vaddr (address))
+    return NULL;
+
+  p.addr = pg_round_down (address);
+  e = hash_find (t->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Adds a mapping for user virtual address VADDR to the current
+   process's page table, initially all zeros.  The caller may set
+   the page's file members before the page is first accessed.
+   Fails if VADDR is already mapped or if memory allocation
+   fails.  Returns the new page if successful, otherwise a null
+   pointer. */
+struct page *
+page_allocate (void *vaddr, bool read_only) 
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+
+  ASSERT (pg_ofs (vaddr) == 0);
+  ASSERT (is_user_vaddr (vaddr));
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+  p->addr = vaddr;
+  p->read_only = read_only;
+  p->thread = t;
+  p->frame = NULL;
+  p->cow = false;
+  p->clock_accessed = p->ws_accessed = false;
+  p->sector = SWAP_NONE;
+  p->private = true;
+  p->file = NULL;
+  p->file_offset = 0;
+  p->file_bytes = 0;
+
+  if (hash_insert (t->pages, &p->hash_elem) != NULL) 
+    {
+      /* Already mapped. */
+      free (p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Removes the page containing VADDR from the current process's
+   page table, writing it back to its file if it belongs to a
+   file mapping and was modified. */
+void
+page_deallocate (void *vaddr) 
+{
+  struct page *p = page_for_addr (vaddr);
+
+  ASSERT (p != NULL);
+  release_page (p);
+  hash_delete (thread_current ()->pages, &p->hash_elem);
+  free (p);
+}
+
+/* Returns true if page P may be mapped writable. */
+static bool
+is_writable (const struct page *p) 
+{
+  return !p->read_only && !p->cow;
+}
+
+/* Returns true if page P, which is not in a frame, is all zeros,
+   so that reads from it can be satisfied by frame_zero. */
+static bool
+is_zero (const struct page *p) 
+{
+  return p->file == NULL && p->sector == SWAP_NONE;
+}
+
+/* Returns true if page P holds read-only data from its file, such
+   as program text, so that other processes that map the same
+   data can share P's frame. */
+static bool
+is_shareable (const struct page *p) 
+{
+  return (p->read_only && p->private && p->file != NULL
+          && p->sector == SWAP_NONE);
+}
+
+/* If P is shareable and another process already has P's data in
+   a frame, adds P to that frame and returns it, locked.
+   Otherwise, returns a null pointer. */
+static struct frame *
+find_shared_frame (struct page *p) 
+{
+  if (!is_shareable (p))
+    return NULL;
+  return frame_share_and_lock (p, file_get_inode (p->file),
+                               p->file_offset, p->file_bytes);
+}
+
+/* Offers P's frame, which must be locked and hold P's data, to
+   other processes that map the same data, if P is shareable. */
+static void
+publish_frame (struct page *p) 
+{
+  if (is_shareable (p))
+    frame_publish (p->frame, file_get_inode (p->file),
+                   p->file_offset, p->file_bytes);
+}
+
+/* Locks a frame for page P and pages in P's contents.
+   Returns true if successful, false on failure. */
+static bool
+do_page_in (struct page *p) 
+{
+  uint8_t *kpage;
+
+  /* Use the frame of another process that maps the same data, if
+     possible. */
+  p->frame = find_shared_frame (p);
+  if (p->frame != NULL)
+    return true;
+
+  /* Get a frame for the page.  The page has the frame to
+     itself, so it is no longer copy-on-write. */
+  p->frame = frame_alloc_and_lock (p);
+  if (p->frame == NULL)
+    return false;
+  kpage = p->frame->base;
+  p->cow = false;
+
+  /* Copy data into the frame. */
+  if (p->sector != SWAP_NONE) 
+    {
+      swap_in (p);
+      return true;
+    }
+  if (p->file != NULL) 
+    {
+      off_t read_bytes = inode_read_uncached (file_get_inode (p->file),
+                                              kpage, p->file_bytes,
+                                              p->file_offset);
+      if (read_bytes != p->file_bytes) 
+        {
+          frame_free (p->frame, p);
+          p->frame = NULL;
+          return false;
+        }
+    }
+  memset (kpage + p->file_bytes, 0, PGSIZE - p->file_bytes);
+  publish_frame (p);
+  return true;
+}
+
+/* Returns true if an access to ADDRESS, which is in no page of
+   the current process, should grow the process's stack, given
+   that its stack pointer is ESP.  The access must be within
+   page_stack_max bytes of the top of user memory, and no more
+   than 32 bytes below the stack pointer, which is as far as the
+   PUSHA instruction reaches. */
+static bool
+is_stack_growth (const void *address, const void *esp) 
+{
+  const uint8_t *stack_bottom = (uint8_t *) PHYS_BASE - page_stack_max;
+
+  return (esp != NULL
+          && is_user_vaddr (address)
+          && (const uint8_t *) address >= stack_bottom
+          && (const uint8_t *) address >= (const uint8_t *) esp - 32);
+}
+
+/* Tries to map Q, a neighbor of a page just faulted in, without
+   waiting for I/O.  This succeeds if Q already has a frame, if
+   another process has Q's data in a frame it can share, or if a
+   frame is free and Q's data is in the buffer cache.  Returns
+   true if Q was mapped. */
+static bool
+map_neighbor (struct page *q) 
+{
+  uint32_t *pd = q->thread->pagedir;
+  struct frame *f = q->frame;
+  bool success;
+
+  if (pagedir_get_page (pd, q->addr) != NULL)
+    return false;
+
+  if (f != NULL) 
+    {
+      /* Already in memory. */
+      if (!lock_try_acquire (&f->lock))
+        return false;
+      if (f != q->frame) 
+        {
+          lock_release (&f->lock);
+          return false;
+        }
+    }
+  else 
+    {
+      if (q->file == NULL || q->sector != SWAP_NONE)
+        return false;
+      f = q->frame = find_shared_frame (q);
+      if (f == NULL) 
+        {
+          f = frame_alloc_free_and_lock (q);
+          if (f == NULL)
+            return false;
+          if (!inode_try_read (file_get_inode (q->file), f->base,
+                               q->file_bytes, q->file_offset)) 
+            {
+              frame_free (f, q);
+              return false;
+            }
+          memset ((uint8_t *) f->base + q->file_bytes, 0,
+                  PGSIZE - q->file_bytes);
+          q->frame = f;
+          publish_frame (q);
+        }
+    }
+
+  /* The mapping starts out not accessed, so that the clock
+     evicts the page early if the process never touches it. */
+  success = pagedir_set_page (pd, q->addr, f->base, is_writable (q));
+  frame_unlock (f);
+  return success;
+}
+
+/* Maps the pages in the window of page_fault_around pages around
+   P, which was just faulted in from a file, that can be mapped
+   without I/O.  This saves a fault for each of them if the
+   process goes on to touch them, as it does when it runs through
+   code or a mapped file sequentially. */
+static void
+fault_around (struct page *p) 
+{
+  uint8_t *first;
+  size_t i;
+
+  if (page_fault_around == 0)
+    return;
+
+  first = (uint8_t *) (pg_no (p->addr) / page_fault_around
+                       * page_fault_around * PGSIZE);
+  for (i = 0; i < page_fault_around; i++) 
+    {
+      uint8_t *addr = first + i * PGSIZE;
+      struct page *q;
+
+      if (addr == p->addr || !is_user_vaddr (addr))
+        continue;
+      q = page_for_addr (addr);
+      if (q != NULL && map_neighbor (q))
+        fault_around_cnt++;
+    }
+}
+
+/* Faults in the page containing FAULT_ADDR, first adding it to
+   the process's stack if it is a stack access according to the
+   user stack pointer ESP.  WRITE is true if the faulting access
+   was a write.  A read from a page that is all zeros maps
+   frame_zero read-only instead of a frame of the page's own;
+   page_unshare() gives the page a frame when it is first
+   written.  Returns true if successful, false if FAULT_ADDR is
+   not part of the current process's address space or if memory
+   is exhausted. */
+bool
+page_in (void *fault_addr, const void *esp, bool write) 
+{
+  struct thread *t = thread_current ();
+  uint32_t *pd = t->pagedir;
+  struct page *p = page_for_addr (fault_addr);
+  bool from_file;
+  bool success = true;
+
+  if (p == NULL) 
+    {
+      if (t->pages == NULL || !is_stack_growth (fault_addr, esp))
+        return false;
+      p = page_allocate (pg_round_down (fault_addr), false);
+      if (p == NULL)
+        return false;
+    }
+  t->fault_cnt++;
+
+  frame_lock (p);
+  if (p->frame == NULL && !write && is_zero (p)) 
+    {
+      /* Only the owning process maps pages without frames, so no
+         lock is needed. */
+      if (!pagedir_set_page (pd, p->addr, frame_zero, false))
+        return false;
+      zero_map_cnt++;
+      return true;
+    }
+
+  from_file = p->frame == NULL && p->file != NULL && p->sector == SWAP_NONE;
+  if (p->frame == NULL) 
+    {
+      if (!do_page_in (p))
+        return false;
+    }
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  /* Install frame into page table.  It may already be there, if
+     an attempt to evict it failed while we waited for the
+     lock. */
+  if (pagedir_get_page (pd, p->addr) == NULL)
+    success = pagedir_set_page (pd, p->addr, p->frame->base,
+                                is_writable (p));
+
+  frame_unlock (p->frame);
+  if (success && from_file)
+    fault_around (p);
+  return success;
+}
+
+/* Evicts page P.  P must have a locked frame.  Returns true if
+   successful, false on failure. */
+bool
+page_out (struct page *p) 
+{
+  uint32_t *pd = p->thread->pagedir;
+
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  /* Mark page not present in page table, forcing accesses by the
+     process to fault.  This must happen before checking the
+     dirty bit, to prevent a race with the process dirtying the
+     page. */
+  pagedir_clear_page (pd, p->addr);
+
+  /* A modified page's contents exist only in its frame, so write
+     them back to its file if it belongs to a file mapping, or to
+     swap otherwise.  If that is impossible, put the page back. */
+  if (pagedir_is_dirty (pd, p->addr) || p->cow) 
+    {
+      bool ok;
+
+      if (p->private)
+        ok = swap_out (p);
+      else
+        ok = (file_write_at (p->file, p->frame->base, p->file_bytes,
+                             p->file_offset) == p->file_bytes);
+      if (!ok) 
+        {
+          pagedir_set_page (pd, p->addr, p->frame->base, is_writable (p));
+          pagedir_set_dirty (pd, p->addr, true);
+          return false;
+        }
+    }
+
+  /* The page can be read back from swap or its file, or
+     zeroed. */
+  p->frame = NULL;
+  p->clock_accessed = p->ws_accessed = false;
+  return true;
+}
+
+/* Moves page P's accessed bit from its page table entry into
+   both of P's copies of it. */
+static void
+collect_accessed (struct page *p) 
+{
+  uint32_t *pd = p->thread->pagedir;
+
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  if (pagedir_is_accessed (pd, p->addr)) 
+    {
+      pagedir_set_accessed (pd, p->addr, false);
+      p->clock_accessed = p->ws_accessed = true;
+    }
+}
+
+/* Returns true if page P's data has been accessed since the last
+   call, false otherwise.  For the clock.  P must have a frame
+   locked into memory. */
+bool
+page_accessed_recently (struct page *p) 
+{
+  bool was_accessed;
+
+  collect_accessed (p);
+  was_accessed = p->clock_accessed;
+  p->clock_accessed = false;
+  return was_accessed;
+}
+
+/* Returns true if page P's data has been accessed since the last
+   call, false otherwise.  For the working set sampler.  P must
+   have a frame locked into memory. */
+bool
+page_sample_accessed (struct page *p) 
+{
+  bool was_accessed;
+
+  collect_accessed (p);
+  was_accessed = p->ws_accessed;
+  p->ws_accessed = false;
+  return was_accessed;
+}
+
+/* Returns true if page P has been modified since it was brought
+   into its frame, or if it is copy-on-write, so that evicting it
+   would require writing it.  P must have a frame locked into
+   memory. */
+bool
+page_is_dirty (struct page *p) 
+{
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  return p->cow || pagedir_is_dirty (p->thread->pagedir, p->addr);
+}
+
+/* Handles a write to the copy-on-write page containing
+   FAULT_ADDR in the current process by giving the page a frame
+   of its own, copying the shared frame if other pages still map
+   it, or replacing frame_zero if the page was mapped to it.
+   Returns true if successful, false if FAULT_ADDR is not in a
+   copy-on-write or zero page or memory is exhausted. */
+bool
+page_unshare (void *fault_addr) 
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  struct page *p = page_for_addr (fault_addr);
+  struct frame *f, *copy;
+  int try;
+
+  if (p == NULL || p->read_only)
+    return false;
+
+  for (try = 0; ; try++) 
+    {
+      frame_lock (p);
+      f = p->frame;
+      if (f == NULL) 
+        {
+          /* Mapped to frame_zero, or evicted meanwhile.  Faulting
+             it in gives it a frame of its own. */
+          pagedir_clear_page (pd, p->addr);
+          return page_in (fault_addr, NULL, true);
+        }
+      if (try == 0)
+        p->thread->fault_cnt++;
+      if (!p->cow) 
+        {
+          /* Already unshared while we waited for the frame. */
+          frame_unlock (f);
+          return true;
+        }
+      if (list_size (&f->pages) == 1)
+        break;
+
+      /* Move to a copy of the frame.  The shared frame stays
+         locked, so its contents cannot change meanwhile, but that
+         also means we must not wait for memory here. */
+      pagedir_clear_page (pd, p->addr);
+      frame_detach (f, p);
+      copy = frame_try_alloc_and_lock (p);
+      if (copy != NULL) 
+        {
+          memcpy (copy->base, f->base, PGSIZE);
+          frame_unlock (f);
+          p->frame = f = copy;
+          break;
+        }
+
+      /* Out of memory.  Put the page back, and wait for memory
+         without the shared frame locked before trying again. */
+      frame_attach (f, p);
+      pagedir_set_page (pd, p->addr, f->base, false);
+      frame_unlock (f);
+      if (try >= 2)
+        return false;
+      timer_msleep (1000);
+    }
+
+  /* The frame's contents now differ from the page's file or swap
+     slot, if not already, so mark it dirty. */
+  p->cow = false;
+  pagedir_clear_page (pd, p->addr);
+  if (!pagedir_set_page (pd, p->addr, f->base, true))
+    {
+      frame_unlock (f);
+      return false;
+    }
+  pagedir_set_dirty (pd, p->addr, true);
+  frame_unlock (f);
+  return true;
+}
+
+/* Copies the pages of PARENT, which must be blocked, into the
+   current process's empty page table, copy-on-write.  Writable
+   pages in memory become copy-on-write in both processes, and
+   read-only pages in memory are simply shared.  Pages that are
+   not in memory are copied as descriptions of where their data
+   comes from, except that pages in swap are read in first, to
+   share them.  No page table entries are copied: the child
+   faults in its pages as it touches them.  File mappings are not
+   inherited.  Returns true if successful, false if memory is
+   exhausted. */
+bool
+page_fork (struct thread *parent) 
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+
+  hash_first (&i, parent->pages);
+  while (hash_next (&i)) 
+    {
+      struct page *pp = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *cp;
+
+      if (!pp->private)
+        continue;
+      cp = page_allocate (pp->addr, pp->read_only);
+      if (cp == NULL)
+        return false;
+      if (pp->file != NULL) 
+        {
+          ASSERT (pp->file == parent->bin_file);
+          cp->file = t->bin_file;
+          cp->file_offset = pp->file_offset;
+          cp->file_bytes = pp->file_bytes;
+        }
+
+      frame_lock (pp);
+      if (pp->frame == NULL && pp->sector != SWAP_NONE
+          && !do_page_in (pp))
+        return false;
+      if (pp->frame != NULL) 
+        {
+          struct frame *f = pp->frame;
+
+          if (!pp->read_only) 
+            {
+              /* Make the parent fault on its next access, to map
+                 the page read-only. */
+              pagedir_clear_page (parent->pagedir, pp->addr);
+              pp->cow = cp->cow = true;
+            }
+          frame_attach (f, cp);
+          cp->frame = f;
+          frame_unlock (f);
+        }
+    }
+  return true;
+}
+
+/* Prints paging statistics. */
+void
+page_print_stats (void) 
+{
+  printf ("Paging: %lld pages mapped by fault-around, "
+          "%lld reads from zero pages\n", fault_around_cnt, zero_map_cnt);
+}
+
+/* Returns a hash value for the page that E refers to. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return ((uintptr_t) p->addr) >> PGBITS;
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED) 
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+
+  return a->addr < b->addr;
+}
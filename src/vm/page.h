@@ -0,0 +1,79 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+#include "filesys/off_t.h"
+
+/* A virtual page of a user process.
+
+   Pages are created when a process's address space is laid out
+   and are brought into memory only when they are first accessed,
+   by page_in() from the page fault handler.  A page in memory
+   occupies a frame, from which page_out() may evict it when
+   frames run short. */
+struct page
+  {
+    void *addr;                 /* User virtual address. */
+    bool read_only;             /* Read-only page? */
+    struct thread *thread;      /* Owning thread. */
+    struct hash_elem hash_elem; /* struct thread `pages' hash element. */
+
+    /* Set only in owning process context with frame->lock held.
+       Cleared only with scan_lock and frame->lock held. */
+    struct frame *frame;        /* Page frame, or a null pointer. */
+    struct list_elem frame_elem; /* struct frame `pages' element. */
+
+    /* A copy-on-write page shares its frame with pages of related
+       processes and is mapped read-only until it is written.  Its
+       contents may exist only in the frame, so it is written to
+       swap if it is evicted, as if it were dirty.  Protected by
+       frame->lock. */
+    bool cow;                   /* Copy-on-write? */
+
+    /* Accessed bit history, protected by frame->lock.  The clock
+       and the working set sampler each clear the accessed bit in
+       the page table entry when they read it, so it is saved here
+       for both of them. */
+    bool clock_accessed;        /* Accessed since the clock looked? */
+    bool ws_accessed;           /* Accessed since the last sample? */
+
+    /* Swap information, protected by frame->lock.  Once a page
+       has been written to swap, its slot holds its contents
+       whenever the page is not in a frame. */
+    disk_sector_t sector;       /* First sector of swap slot, or
+                                   SWAP_NONE. */
+
+    /* Initial contents: FILE_BYTES bytes read from FILE starting
+       at FILE_OFFSET, followed by zeros.  If FILE is null, the
+       page is all zeros.  A page that is not PRIVATE belongs to a
+       file mapping and is written back to FILE, not to swap. */
+    bool private;               /* False to write back to FILE. */
+    struct file *file;          /* File, or a null pointer. */
+    off_t file_offset;          /* Offset in file. */
+    off_t file_bytes;           /* Bytes to read or write, 1...PGSIZE. */
+  };
+
+/* Maximum size of a process's stack, in bytes. */
+extern size_t page_stack_max;
+
+/* Number of pages around a faulting page to map with it. */
+extern size_t page_fault_around;
+
+bool page_init (void);
+void page_exit (void);
+void page_print_stats (void);
+
+struct page *page_allocate (void *vaddr, bool read_only);
+void page_deallocate (void *vaddr);
+bool page_in (void *fault_addr, const void *esp, bool write);
+bool page_unshare (void *fault_addr);
+bool page_fork (struct thread *parent);
+bool page_out (struct page *);
+bool page_accessed_recently (struct page *);
+bool page_sample_accessed (struct page *);
+bool page_is_dirty (struct page *);
+
+#endif /* vm/page.h */
@@ -0,0 +1,121 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* The swap disk. */
+static struct disk *swap_disk;
+
+/* Used swap slots, one bit per page-sized slot. */
+static struct bitmap *swap_bitmap;
+
+/* Protects swap_bitmap. */
+static struct lock swap_lock;
+
+/* Number of sectors per page. */
+#define PAGE_SECTORS (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Sets up swap on hd1:1.  Without a swap disk, or if hd1:1 holds
+   half of a striped file system, pages that exist only in memory
+   cannot be evicted. */
+void
+swap_init (void) 
+{
+  if (filesys_stripe) 
+    {
+      printf ("swap: hd1:1 (hdd) is striped into the file system, "
+              "swap disabled\n");
+      return;
+    }
+  swap_disk = disk_get (1, 1);
+  if (swap_disk == NULL) 
+    {
+      printf ("swap: hd1:1 (hdd) not present, swap disabled\n");
+      return;
+    }
+  swap_bitmap = bitmap_create (disk_size (swap_disk) / PAGE_SECTORS);
+  if (swap_bitmap == NULL)
+    PANIC ("couldn't create swap bitmap");
+  lock_init (&swap_lock);
+}
+
+/* Allocates a swap slot for page P, preferring the slot that
+   P's owner and virtual address hash to.  Adjacent pages of a
+   process hash to adjacent slots, so pages that are evicted
+   together tend to be written to, and read back from, nearby
+   sectors, and the disk elevator can merge their transfers.
+   Returns the slot's first sector, or SWAP_NONE if swap is
+   full. */
+static disk_sector_t
+allocate_slot (const struct page *p) 
+{
+  size_t slot_cnt = bitmap_size (swap_bitmap);
+  size_t start = ((hash_int (p->thread->tid)
+                   + ((uintptr_t) p->addr >> PGBITS)) % slot_cnt);
+  size_t slot;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_bitmap, start, 1, false);
+  if (slot == BITMAP_ERROR)
+    slot = bitmap_scan_and_flip (swap_bitmap, 0, 1, false);
+  lock_release (&swap_lock);
+
+  return slot != BITMAP_ERROR ? slot * PAGE_SECTORS : SWAP_NONE;
+}
+
+/* Reads page P's contents from its swap slot into its frame,
+   which must be locked.  The slot remains allocated to P, so
+   that P can be evicted again without writing it if it is not
+   modified in the meantime. */
+void
+swap_in (struct page *p) 
+{
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+  ASSERT (p->sector != SWAP_NONE);
+
+  disk_read_multiple (swap_disk, p->sector, PAGE_SECTORS, p->frame->base);
+}
+
+/* Writes page P's frame, which must be locked, to its swap slot,
+   allocating one if P does not have one yet.  The page is
+   written with a single multi-sector transfer.  Returns true if
+   successful, false if there is no swap disk or it is full. */
+bool
+swap_out (struct page *p) 
+{
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  if (swap_disk == NULL)
+    return false;
+  if (p->sector == SWAP_NONE) 
+    {
+      p->sector = allocate_slot (p);
+      if (p->sector == SWAP_NONE)
+        return false;
+    }
+
+  disk_write_multiple (swap_disk, p->sector, PAGE_SECTORS, p->frame->base);
+  return true;
+}
+
+/* Releases page P's swap slot, if it has one. */
+void
+swap_free (struct page *p) 
+{
+  if (p->sector != SWAP_NONE) 
+    {
+      lock_acquire (&swap_lock);
+      bitmap_reset (swap_bitmap, p->sector / PAGE_SECTORS);
+      lock_release (&swap_lock);
+      p->sector = SWAP_NONE;
+    }
+}
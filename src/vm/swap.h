@@ -0,0 +1,17 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+/* Swap sector of a page that has no swap slot. */
+#define SWAP_NONE ((disk_sector_t) -1)
+
+struct page;
+
+void swap_init (void);
+void swap_in (struct page *);
+bool swap_out (struct page *);
+void swap_free (struct page *);
+
+#endif /* vm/swap.h */